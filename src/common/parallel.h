@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// this header-only module is shared by the other modules (it has no dependency).
+
+namespace uwpreprocess {
+
+// calls function(thread_index, item) for each item in [0, nb_items), the items being dynamically distributed among the
+// threads by chunks (the cost of an item may vary a lot, so a static split would be unbalanced).
+// If some calls throw, the other items are still processed, then the exception of the smallest item is rethrown in the
+// calling thread, once all the threads are done (thus, it doesn't depend on the number of threads).
+template <typename Function>
+void parallel_for(size_t nb_items, size_t nb_threads, Function function, size_t chunk_size = 64) {
+    std::atomic<size_t> next_item{0};
+    std::mutex error_mutex;
+    size_t error_item = nb_items;
+    std::exception_ptr error;
+    auto process_items = [&](size_t thread_index) {
+        size_t first;
+        while ((first = next_item.fetch_add(chunk_size)) < nb_items) {
+            for (size_t item = first; item < std::min(first + chunk_size, nb_items); ++item) {
+                try {
+                    function(thread_index, item);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock{error_mutex};
+                    if (item < error_item) {
+                        error_item = item;
+                        error = std::current_exception();
+                    }
+                }
+            }
+        }
+    };
+    if (nb_threads <= 1) {
+        process_items(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (size_t thread_index = 0; thread_index < nb_threads; ++thread_index) {
+            workers.emplace_back(process_items, thread_index);
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+}  // namespace uwpreprocess
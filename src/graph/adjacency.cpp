@@ -0,0 +1,43 @@
+#include <limits>
+#include <stdexcept>
+
+#include "graph/adjacency.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+CsrAdjacency CsrAdjacency::build(vector<Edge> const& edges, size_t nb_nodes) {
+    if (edges.size() >= numeric_limits<Index>::max() || nb_nodes >= numeric_limits<Index>::max()) {
+        throw runtime_error("ERROR : graph is too large for a CSR adjacency with 32 bits indexes");
+    }
+
+    CsrAdjacency adjacency;
+
+    // counting the out-degree of each node :
+    adjacency.offsets.assign(nb_nodes + 1, 0);
+    for (auto const& edge : edges) {
+        ++adjacency.offsets[edge.node_from.get_rank() + 1];
+    }
+
+    // prefix sum (offsets[R] is now the position of the first out-edge of R) :
+    for (size_t rank = 0; rank < nb_nodes; ++rank) {
+        adjacency.offsets[rank + 1] += adjacency.offsets[rank];
+    }
+
+    // placing each edge (the sort is stable, so the out-edges of a node are in the edge list order) :
+    vector<Index> next_position(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    adjacency.targets.resize(edges.size());
+    adjacency.weights.resize(edges.size());
+    adjacency.edge_indexes.resize(edges.size());
+    for (size_t edge_index = 0; edge_index < edges.size(); ++edge_index) {
+        auto const& edge = edges[edge_index];
+        Index position = next_position[edge.node_from.get_rank()]++;
+        adjacency.targets[position] = static_cast<Index>(edge.node_to.get_rank());
+        adjacency.weights[position] = edge.weight;
+        adjacency.edge_indexes[position] = static_cast<Index>(edge_index);
+    }
+    return adjacency;
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "graph/graphtypes.h"
+
+namespace uwpreprocess {
+
+// CsrAdjacency is a compressed-sparse-row representation of the out-edges of a graph's nodes :
+//  - the out-edges of the node of rank R are the indexes offsets[R] to offsets[R+1]-1 of the other arrays
+//  - targets, weights and edge_indexes are stored contiguously, sorted by source rank
+//  - for a given source, the out-edges are in the same order than in the edge list
+// This is the representation to use for any in-process traversal of the graph (routing, validation, etc.)
+struct CsrAdjacency {
+    using Index = uint32_t;  // 32 bits indexes are enough for nodes and edges, and halve the memory use
+
+    struct OutEdge {
+        Index target;
+        float weight;
+        Index edge_index;  // index of the edge in the graph's edge list
+    };
+
+    // range of the out-edges of a given node :
+    class OutEdges {
+       public:
+        class iterator {
+           public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = OutEdge;
+            using difference_type = std::ptrdiff_t;
+            using pointer = OutEdge const*;
+            using reference = OutEdge;
+
+            inline iterator(CsrAdjacency const& adjacency_, size_t position_)
+                : adjacency{&adjacency_}, position{position_} {}
+            inline OutEdge operator*() const {
+                return {adjacency->targets[position], adjacency->weights[position], adjacency->edge_indexes[position]};
+            }
+            inline iterator& operator++() {
+                ++position;
+                return *this;
+            }
+            inline bool operator==(iterator const& other) const { return position == other.position; }
+            inline bool operator!=(iterator const& other) const { return position != other.position; }
+
+           private:
+            CsrAdjacency const* adjacency;
+            size_t position;
+        };
+
+        inline OutEdges(CsrAdjacency const& adjacency_, size_t first_, size_t last_)
+            : adjacency{adjacency_}, first{first_}, last{last_} {}
+        inline iterator begin() const { return {adjacency, first}; }
+        inline iterator end() const { return {adjacency, last}; }
+        inline size_t size() const { return last - first; }
+
+       private:
+        CsrAdjacency const& adjacency;
+        size_t first;
+        size_t last;
+    };
+
+    // built in O(E) with a counting sort on the source ranks (precondition = all the nodes are ranked) :
+    static CsrAdjacency build(std::vector<Edge> const& edges, size_t nb_nodes);
+
+    inline size_t nb_nodes() const { return offsets.size() - 1; }
+    inline size_t nb_edges() const { return targets.size(); }
+    inline size_t degree(size_t rank) const { return offsets[rank + 1] - offsets[rank]; }
+    inline OutEdges out_edges(size_t rank) const { return {*this, offsets[rank], offsets[rank + 1]}; }
+
+    inline bool operator==(CsrAdjacency const& other) const {
+        return offsets == other.offsets && targets == other.targets && weights == other.weights &&
+               edge_indexes == other.edge_indexes;
+    }
+
+    std::vector<Index> offsets{0};
+    std::vector<Index> targets;
+    std::vector<float> weights;
+    std::vector<Index> edge_indexes;
+};
+
+}  // namespace uwpreprocess
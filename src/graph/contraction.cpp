@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+
+#include "graph/contraction.h"
+#include "common/parallel.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+using Neighbours = vector<pair<uint32_t, float>>;  // (neighbour, weight)
+
+enum class NodeState : uint8_t { REMAINING, IN_BATCH, CONTRACTED };
+
+// A witness search is a local Dijkstra in the remaining graph, that avoids the node being contracted (and the other
+// nodes of its batch). It is limited in distance and in number of settled nodes : if a witness is missed because of
+// those limits, an unnecessary shortcut is added, which is harmless.
+class WitnessSearch {
+   public:
+
+    explicit WitnessSearch(size_t nb_nodes)
+        : distances(nb_nodes, numeric_limits<float>::infinity()), is_target(nb_nodes, false) {}
+
+    // the search stops as soon as all the targets are settled :
+    void run(uint32_t source,
+             uint32_t avoided,
+             vector<uint32_t> const& targets,
+             float max_distance,
+             size_t max_settled_nodes,
+             vector<Neighbours> const& neighbours,
+             vector<NodeState> const& states) {
+        for (uint32_t target : targets) {
+            is_target[target] = true;
+        }
+        size_t nb_unsettled_targets = targets.size();
+
+        set_distance(source, 0);
+        queue.clear();
+        push(0, source);
+        size_t nb_settled = 0;
+        while (!queue.empty() && nb_settled < max_settled_nodes && nb_unsettled_targets > 0) {
+            auto [distance, node] = pop();
+            if (distance > distances[node])
+                continue;
+            ++nb_settled;
+            if (is_target[node])
+                --nb_unsettled_targets;
+            for (auto [neighbour, weight] : neighbours[node]) {
+                float new_distance = distance + weight;
+                if (neighbour == avoided || states[neighbour] != NodeState::REMAINING || new_distance > max_distance ||
+                    new_distance >= distances[neighbour])
+                    continue;
+                set_distance(neighbour, new_distance);
+                push(new_distance, neighbour);
+            }
+        }
+    }
+
+    inline float distance(uint32_t node) const { return distances[node]; }
+
+    void reset(vector<uint32_t> const& targets) {
+        for (uint32_t node : touched) {
+            distances[node] = numeric_limits<float>::infinity();
+        }
+        touched.clear();
+        for (uint32_t target : targets) {
+            is_target[target] = false;
+        }
+    }
+
+   private:
+    // the heap is a plain vector, so that its memory is reused from one search to the next :
+    using QueueItem = pair<float, uint32_t>;
+    inline void push(float distance, uint32_t node) {
+        queue.emplace_back(distance, node);
+        push_heap(queue.begin(), queue.end(), greater<QueueItem>{});
+    }
+    inline QueueItem pop() {
+        pop_heap(queue.begin(), queue.end(), greater<QueueItem>{});
+        QueueItem top = queue.back();
+        queue.pop_back();
+        return top;
+    }
+
+    inline void set_distance(uint32_t node, float distance) {
+        if (distances[node] == numeric_limits<float>::infinity())
+            touched.push_back(node);
+        distances[node] = distance;
+    }
+
+    vector<float> distances;
+    vector<uint32_t> touched;
+    vector<uint8_t> is_target;
+    vector<QueueItem> queue;
+};
+
+class Contractor {
+   public:
+    Contractor(WalkingGraph const& graph, size_t nb_threads_)
+        : nb_threads{max(nb_threads_, size_t{1})},
+          neighbours(graph.out_edges.nb_nodes()),
+          states(graph.out_edges.nb_nodes(), NodeState::REMAINING),
+          is_candidate(graph.out_edges.nb_nodes(), false),
+          nb_contracted_neighbours(graph.out_edges.nb_nodes(), 0),
+          priorities(graph.out_edges.nb_nodes(), 0) {
+        // the hierarchy is undirected (precondition = each edge of the walking graph has its reversed edge) :
+        // parallel edges are merged (keeping the lightest), and loops are ignored.
+        for (size_t node = 0; node < graph.out_edges.nb_nodes(); ++node) {
+            for (auto out_edge : graph.out_edges.out_edges(node)) {
+                if (out_edge.target != node)
+                    add_or_improve_edge(static_cast<uint32_t>(node), out_edge.target, out_edge.weight);
+            }
+        }
+        hierarchy.levels.assign(graph.out_edges.nb_nodes(), ContractionHierarchy::UNCONTRACTED);
+        for (size_t thread_index = 0; thread_index < nb_threads; ++thread_index) {
+            searches.emplace_back(graph.out_edges.nb_nodes());
+        }
+    }
+
+    // contracts the given nodes (and only them) :
+    void contract(vector<uint32_t> candidates) {
+        for (uint32_t node : candidates) {
+            is_candidate[node] = true;
+        }
+        update_priorities(candidates);
+
+        while (!candidates.empty()) {
+            vector<uint32_t> batch = select_independent_set(candidates);
+            contract_batch(batch);
+            candidates.erase(remove_if(candidates.begin(), candidates.end(),
+                                       [this](uint32_t node) { return states[node] == NodeState::CONTRACTED; }),
+                             candidates.end());
+        }
+    }
+
+    ContractionHierarchy hierarchy;
+    uint32_t nb_rounds = 0;
+
+   private:
+    void add_or_improve_edge(uint32_t from, uint32_t to, float weight) {
+        auto improve = [weight](Neighbours& node_neighbours, uint32_t neighbour) {
+            for (auto& [existing, existing_weight] : node_neighbours) {
+                if (existing == neighbour) {
+                    existing_weight = min(existing_weight, weight);
+                    return;
+                }
+            }
+            node_neighbours.emplace_back(neighbour, weight);
+        };
+        improve(neighbours[from], to);
+        improve(neighbours[to], from);
+    }
+
+    // the shortcuts needed if node was contracted now (each pair of neighbours is considered once) :
+    // (the priorities are only estimations, so their witness searches are more limited than the actual contraction's)
+    static constexpr const size_t MAX_SETTLED_NODES_ESTIMATION = 10;
+    static constexpr const size_t MAX_SETTLED_NODES_CONTRACTION = 1000;
+    void compute_shortcuts(uint32_t node,
+                           WitnessSearch& search,
+                           size_t max_settled_nodes,
+                           vector<ContractionHierarchy::Shortcut>& shortcuts) {
+        auto const& node_neighbours = neighbours[node];
+        float max_weight = 0;
+        for (auto [_, weight] : node_neighbours) {
+            max_weight = max(max_weight, weight);
+        }
+        vector<uint32_t> targets;
+        for (size_t first = 0; first + 1 < node_neighbours.size(); ++first) {
+            auto [from, from_weight] = node_neighbours[first];
+            targets.clear();
+            for (size_t second = first + 1; second < node_neighbours.size(); ++second) {
+                targets.push_back(node_neighbours[second].first);
+            }
+            search.run(from, node, targets, from_weight + max_weight, max_settled_nodes, neighbours, states);
+            for (size_t second = first + 1; second < node_neighbours.size(); ++second) {
+                auto [to, to_weight] = node_neighbours[second];
+                if (search.distance(to) > from_weight + to_weight) {
+                    shortcuts.push_back({from, to, from_weight + to_weight, node});
+                }
+            }
+            search.reset(targets);
+        }
+    }
+
+    void update_priorities(vector<uint32_t> const& nodes) {
+        // priority = edge difference + number of already contracted neighbours (which spreads the contraction) :
+        vector<vector<ContractionHierarchy::Shortcut>> shortcuts_by_thread(nb_threads);
+        parallel_for(nodes.size(), nb_threads, [this, &nodes, &shortcuts_by_thread](size_t thread_index, size_t item) {
+            uint32_t node = nodes[item];
+            auto& shortcuts = shortcuts_by_thread[thread_index];
+            shortcuts.clear();
+            compute_shortcuts(node, searches[thread_index], MAX_SETTLED_NODES_ESTIMATION, shortcuts);
+            priorities[node] = static_cast<int64_t>(shortcuts.size()) -
+                               static_cast<int64_t>(neighbours[node].size()) + nb_contracted_neighbours[node];
+        });
+    }
+
+    inline bool has_precedence(uint32_t node, uint32_t other) const {
+        // ties are broken with a hash of the nodes, so that the selected nodes are spread over the graph :
+        auto hash = [](uint64_t x) {
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        };
+        return make_tuple(priorities[node], hash(node), node) < make_tuple(priorities[other], hash(other), other);
+    }
+
+    vector<uint32_t> select_independent_set(vector<uint32_t> const& candidates) {
+        // a candidate is selected if it has precedence over all its candidate neighbours :
+        // thus, no two selected nodes are adjacent, and they can be contracted independently.
+        vector<vector<uint32_t>> selected_by_thread(nb_threads);
+        parallel_for(candidates.size(), nb_threads,
+                     [this, &candidates, &selected_by_thread](size_t thread_index, size_t item) {
+                         uint32_t node = candidates[item];
+                         for (auto [neighbour, _] : neighbours[node]) {
+                             if (is_candidate[neighbour] && !has_precedence(node, neighbour))
+                                 return;
+                         }
+                         selected_by_thread[thread_index].push_back(node);
+                     });
+        vector<uint32_t> selected;
+        for (auto const& thread_selected : selected_by_thread) {
+            selected.insert(selected.end(), thread_selected.begin(), thread_selected.end());
+        }
+        sort(selected.begin(), selected.end());  // the contraction must not depend on the threads scheduling
+        return selected;
+    }
+
+    void contract_batch(vector<uint32_t> const& batch) {
+        // the nodes of the batch are avoided by the witness searches of the others nodes of the batch :
+        // otherwise, two nodes could each use a path through the other as a witness, and both be removed.
+        for (uint32_t node : batch) {
+            states[node] = NodeState::IN_BATCH;
+        }
+        vector<vector<ContractionHierarchy::Shortcut>> shortcuts_by_node(batch.size());
+        parallel_for(batch.size(), nb_threads, [this, &batch, &shortcuts_by_node](size_t thread_index, size_t item) {
+            compute_shortcuts(batch[item], searches[thread_index], MAX_SETTLED_NODES_CONTRACTION,
+                              shortcuts_by_node[item]);
+        });
+
+        // the graph is updated sequentially :
+        vector<uint32_t> nodes_to_update;
+        for (size_t item = 0; item < batch.size(); ++item) {
+            uint32_t node = batch[item];
+            for (auto const& shortcut : shortcuts_by_node[item]) {
+                add_or_improve_edge(shortcut.from, shortcut.to, shortcut.weight);
+                hierarchy.shortcuts.push_back(shortcut);
+            }
+            for (auto [neighbour, _] : neighbours[node]) {
+                auto& neighbour_neighbours = neighbours[neighbour];
+                neighbour_neighbours.erase(
+                    remove_if(neighbour_neighbours.begin(), neighbour_neighbours.end(),
+                              [node](pair<uint32_t, float> const& edge) { return edge.first == node; }),
+                    neighbour_neighbours.end());
+                ++nb_contracted_neighbours[neighbour];
+                if (is_candidate[neighbour])
+                    nodes_to_update.push_back(neighbour);
+            }
+            neighbours[node] = Neighbours{};
+            states[node] = NodeState::CONTRACTED;
+            is_candidate[node] = false;
+            hierarchy.levels[node] = nb_rounds;
+        }
+        ++nb_rounds;
+
+        sort(nodes_to_update.begin(), nodes_to_update.end());
+        nodes_to_update.erase(unique(nodes_to_update.begin(), nodes_to_update.end()), nodes_to_update.end());
+        nodes_to_update.erase(remove_if(nodes_to_update.begin(), nodes_to_update.end(),
+                                        [this](uint32_t node) { return !is_candidate[node]; }),
+                              nodes_to_update.end());
+        update_priorities(nodes_to_update);
+    }
+
+    size_t nb_threads;
+    vector<Neighbours> neighbours;  // the edges of the remaining graph (original edges + shortcuts)
+    vector<NodeState> states;
+    vector<uint8_t> is_candidate;  // not a vector<bool>, as it is read concurrently
+    vector<int64_t> nb_contracted_neighbours;
+    vector<int64_t> priorities;
+    vector<WitnessSearch> searches;  // one per thread
+};
+
+ContractionHierarchy contract_graph(WalkingGraph const& graph, StopsContraction stops_contraction, size_t nb_threads) {
+    // stops are ranked first : the nodes [0, nb_stops) are the stops
+    size_t nb_stops = graph.stops_with_closest_node.size();
+    size_t nb_nodes = graph.out_edges.nb_nodes();
+    Contractor contractor{graph, nb_threads};
+
+    vector<uint32_t> other_nodes;
+    for (size_t node = nb_stops; node < nb_nodes; ++node) {
+        other_nodes.push_back(static_cast<uint32_t>(node));
+    }
+    contractor.contract(move(other_nodes));
+
+    if (stops_contraction == StopsContraction::LAST) {
+        vector<uint32_t> stops;
+        for (size_t node = 0; node < min(nb_stops, nb_nodes); ++node) {
+            stops.push_back(static_cast<uint32_t>(node));
+        }
+        contractor.contract(move(stops));
+    }
+
+    cout << "Contraction hierarchy : " << contractor.nb_rounds << " levels, "
+         << contractor.hierarchy.shortcuts.size() << " shortcuts" << endl;
+    return move(contractor.hierarchy);
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "graph/walking_graph.h"
+
+namespace uwpreprocess {
+
+// What to do with the stops when contracting the graph :
+//  - LAST : the stops are contracted after all the other nodes (they are the top of the hierarchy)
+//  - KEPT : the stops are never contracted (they form the core of the hierarchy, linked by shortcuts)
+enum class StopsContraction { LAST, KEPT };
+
+// A Contraction Hierarchy of a walking graph (nodes are identified by their rank) :
+//  - the level of a node is the round in which it was contracted (the nodes contracted in the same round are never
+//    adjacent, so the levels are enough to direct the edges upwards)
+//  - a shortcut from->to replaces the path from->via->to, where via is a node of lower level than from and to
+// As the walking graph is bidirectional, the hierarchy is undirected : each shortcut stands for both directions.
+struct ContractionHierarchy {
+    static constexpr const uint32_t UNCONTRACTED = std::numeric_limits<uint32_t>::max();
+
+    struct Shortcut {
+        uint32_t from;
+        uint32_t to;
+        float weight;
+        uint32_t via;
+    };
+
+    std::vector<uint32_t> levels;  // indexed by node rank
+    std::vector<Shortcut> shortcuts;
+};
+
+// The nodes are ordered by edge difference (+ number of contracted neighbours), and contracted by batches of
+// independent nodes (each batch being processed in parallel).
+ContractionHierarchy contract_graph(WalkingGraph const& graph,
+                                    StopsContraction stops_contraction,
+                                    size_t nb_threads = std::thread::hardware_concurrency());
+
+}  // namespace uwpreprocess
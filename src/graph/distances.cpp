@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <osmium/geom/haversine.hpp>
+
+#include "graph/distances.h"
+#include "graph/distances_kernel.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+#if defined(UWPREPROCESS_AVX2_DISTANCE_KERNEL)
+// defined in distances_avx2.cpp (the only translation unit compiled with AVX2) :
+void distances_in_meters_avx2(double const* lon1,
+                              double const* lat1,
+                              double const* lon2,
+                              double const* lat2,
+                              size_t nb_padded_segments,
+                              double* distances,
+                              bool is_haversine);
+#endif
+
+static_assert(EARTH_RADIUS_IN_METERS == osmium::geom::haversine::EARTH_RADIUS_IN_METERS);
+
+bool is_distance_kernel_supported(DistanceKernel kernel) {
+    switch (kernel) {
+        case DistanceKernel::SCALAR:
+            return true;
+        case DistanceKernel::SSE2:
+#if defined(__SSE2__)
+            return true;
+#else
+            return false;
+#endif
+        case DistanceKernel::AVX2:
+#if defined(UWPREPROCESS_AVX2_DISTANCE_KERNEL)
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+DistanceKernel best_distance_kernel() {
+    static DistanceKernel const best = []() {
+        for (auto kernel : {DistanceKernel::AVX2, DistanceKernel::SSE2}) {
+            if (is_distance_kernel_supported(kernel))
+                return kernel;
+        }
+        return DistanceKernel::SCALAR;
+    }();
+    return best;
+}
+
+string to_string(DistanceKernel kernel) {
+    switch (kernel) {
+        case DistanceKernel::SCALAR:
+            return "scalar";
+        case DistanceKernel::SSE2:
+            return "sse2";
+        case DistanceKernel::AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+void distances_in_meters(osmium::Location const* from,
+                         osmium::Location const* to,
+                         size_t nb_segments,
+                         double* distances,
+                         DistanceMode mode,
+                         DistanceKernel kernel) {
+    if (!is_distance_kernel_supported(kernel)) {
+        throw runtime_error("ERROR : the distance kernel '" + to_string(kernel) + "' is not supported by this CPU");
+    }
+
+    // The segments are processed by blocks : the coordinates of a block are first converted (here, as this translation
+    // unit is not compiled with AVX2) into contiguous arrays of doubles, padded to a multiple of the number of lanes,
+    // on which the kernel then runs.
+    constexpr const size_t BLOCK_SIZE = 256;
+    static_assert(BLOCK_SIZE % KERNEL_MAX_LANES == 0);
+    alignas(32) double lon1[BLOCK_SIZE];
+    alignas(32) double lat1[BLOCK_SIZE];
+    alignas(32) double lon2[BLOCK_SIZE];
+    alignas(32) double lat2[BLOCK_SIZE];
+    alignas(32) double block_distances[BLOCK_SIZE];
+    bool const is_haversine = mode == DistanceMode::HAVERSINE;
+    for (size_t first = 0; first < nb_segments; first += BLOCK_SIZE) {
+        size_t block_size = min(BLOCK_SIZE, nb_segments - first);
+        for (size_t index = 0; index < block_size; ++index) {
+            lon1[index] = from[first + index].lon();
+            lat1[index] = from[first + index].lat();
+            lon2[index] = to[first + index].lon();
+            lat2[index] = to[first + index].lat();
+        }
+        size_t padded_size = (block_size + KERNEL_MAX_LANES - 1) / KERNEL_MAX_LANES * KERNEL_MAX_LANES;
+        for (size_t index = block_size; index < padded_size; ++index) {
+            lon1[index] = lat1[index] = lon2[index] = lat2[index] = 0;
+        }
+
+        switch (kernel) {
+            case DistanceKernel::SCALAR:
+                _distances_kernel<double>(lon1, lat1, lon2, lat2, padded_size, block_distances, is_haversine);
+                break;
+            case DistanceKernel::SSE2:
+#if defined(__SSE2__)
+                _distances_kernel<Double2>(lon1, lat1, lon2, lat2, padded_size, block_distances, is_haversine);
+#endif
+                break;
+            case DistanceKernel::AVX2:
+#if defined(UWPREPROCESS_AVX2_DISTANCE_KERNEL)
+                distances_in_meters_avx2(lon1, lat1, lon2, lat2, padded_size, block_distances, is_haversine);
+#endif
+                break;
+        }
+        memcpy(distances + first, block_distances, block_size * sizeof(double));
+    }
+}
+
+float polyline_length_in_meters(osmium::Location const* locations,
+                                size_t nb_locations,
+                                DistanceMode mode,
+                                DistanceKernel kernel) {
+    // precondition = polyline has at least 2 points
+    // the segments are measured by blocks, then summed in the order of the polyline :
+    constexpr const size_t BLOCK_SIZE = 64;
+    double distances[BLOCK_SIZE];
+    float total_length = 0;
+    for (size_t first = 0; first + 1 < nb_locations; first += BLOCK_SIZE) {
+        size_t nb_segments = min(BLOCK_SIZE, nb_locations - 1 - first);
+        distances_in_meters(locations + first, locations + first + 1, nb_segments, distances, mode, kernel);
+        for (size_t index = 0; index < nb_segments; ++index) {
+            total_length += distances[index];
+        }
+    }
+    return total_length;
+}
+
+}  // namespace uwpreprocess
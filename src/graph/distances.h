@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <osmium/osm/location.hpp>
+
+namespace uwpreprocess {
+
+// How the distance between two locations is computed :
+//  - HAVERSINE       : great-circle distance, same formula (and earth radius) as osmium::geom::haversine::distance
+//                      (the polynomial approximations of the trigonometric functions keep the relative difference
+//                      below 1e-12)
+//  - EQUIRECTANGULAR : the segment is projected on the plane tangent at its mean latitude, which is far cheaper.
+//                      For segments shorter than 1 km, under 70 degrees of latitude, the relative error (with respect
+//                      to HAVERSINE) is below 1e-7, i.e. 0.1 mm for a 1 km segment (the error grows with the square
+//                      of the length) : it is meant for the short segments of the OSM ways, not for long distances.
+enum class DistanceMode { HAVERSINE, EQUIRECTANGULAR };
+
+// The SIMD instruction set used to compute the distances : all kernels return exactly the same values (they run the
+// same operations, only on more lanes at once), thus the choice of the kernel never changes the output.
+enum class DistanceKernel { SCALAR, SSE2, AVX2 };
+
+// the fastest kernel supported by the running CPU (detected once) :
+DistanceKernel best_distance_kernel();
+bool is_distance_kernel_supported(DistanceKernel kernel);
+std::string to_string(DistanceKernel kernel);
+
+// distances[i] = distance (in meters) between from[i] and to[i], for i in [0, nb_segments) :
+void distances_in_meters(osmium::Location const* from,
+                         osmium::Location const* to,
+                         size_t nb_segments,
+                         double* distances,
+                         DistanceMode mode = DistanceMode::HAVERSINE,
+                         DistanceKernel kernel = best_distance_kernel());
+
+// length of the polyline made of the given locations (precondition = at least 2 locations) :
+float polyline_length_in_meters(osmium::Location const* locations,
+                                size_t nb_locations,
+                                DistanceMode mode = DistanceMode::HAVERSINE,
+                                DistanceKernel kernel = best_distance_kernel());
+
+}  // namespace uwpreprocess
@@ -0,0 +1,23 @@
+// this translation unit is compiled with AVX2 enabled (see CMakeLists.txt) : it must only be called after checking that
+// the running CPU supports it (see is_distance_kernel_supported).
+// It only includes the kernel, that handles raw arrays of doubles and calls no function defined elsewhere.
+
+#include "graph/distances_kernel.h"
+
+#if !defined(__AVX2__)
+#error "distances_avx2.cpp must be compiled with AVX2 enabled"
+#endif
+
+namespace uwpreprocess {
+
+void distances_in_meters_avx2(double const* lon1,
+                              double const* lat1,
+                              double const* lon2,
+                              double const* lat2,
+                              size_t nb_padded_segments,
+                              double* distances,
+                              bool is_haversine) {
+    _distances_kernel<Double4>(lon1, lat1, lon2, lat2, nb_padded_segments, distances, is_haversine);
+}
+
+}  // namespace uwpreprocess
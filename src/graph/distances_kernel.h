@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// This header is the implementation of the distance kernels : it is included by the translation units that instantiate
+// a kernel, each one being compiled for its own instruction set (see CMakeLists.txt).
+// The code is written once, for a "vector of doubles" V : either a plain double (scalar kernel), or a GCC vector
+// extension type, on which the arithmetic operators and the ternary operator act lane-wise.
+// Everything is static (internal linkage) : the instantiations of the different translation units must never be mixed
+// up by the linker, as they don't run on the same CPUs. For the same reason, this header calls no function defined
+// elsewhere (not even an inline one, e.g. osmium::Location::lon or std::min, whose out-of-line copy could be the one
+// compiled with AVX2 and be kept by the linker for the whole program) : the kernels only see raw arrays of doubles,
+// the locations being converted by the caller (see distances.cpp, which is not compiled with AVX2).
+//
+// Only +, -, *, / and sqrt are used (the trigonometric functions are polynomial approximations), and they are all
+// correctly rounded, lane by lane : thus, a given segment gets exactly the same distance, whatever the kernel.
+
+namespace uwpreprocess {
+
+using Double2 = double __attribute__((vector_size(16)));
+using Double4 = double __attribute__((vector_size(32)));
+
+static constexpr const double PI = 3.14159265358979323846;
+static constexpr const double HALF_PI = PI / 2;
+static constexpr const double DEG_TO_RAD = PI / 180;
+static constexpr const double EARTH_RADIUS_IN_METERS = 6372797.560856;  // (same as osmium, see distances.cpp)
+
+// the kernels process the segments by groups of this size (the arrays given to them are padded to a multiple of it) :
+static constexpr const size_t KERNEL_MAX_LANES = 4;
+
+template <typename V>
+static inline V _broadcast(double value) {
+    return V{} + value;
+}
+
+static inline double _sqrt(double x) {
+    return __builtin_sqrt(x);
+}
+#if defined(__SSE2__)
+static inline Double2 _sqrt(Double2 x) {
+    return _mm_sqrt_pd(x);
+}
+#endif
+#if defined(__AVX__)
+static inline Double4 _sqrt(Double4 x) {
+    return _mm256_sqrt_pd(x);
+}
+#endif
+
+// sin(x) for |x| <= pi/2 : Taylor polynomial up to x^19 (absolute error below 3e-16)
+template <typename V>
+static inline V _sin(V x) {
+    V x2 = x * x;
+    V p = _broadcast<V>(-1.0 / 121645100408832000.0);
+    p = p * x2 + 1.0 / 355687428096000.0;
+    p = p * x2 - 1.0 / 1307674368000.0;
+    p = p * x2 + 1.0 / 6227020800.0;
+    p = p * x2 - 1.0 / 39916800.0;
+    p = p * x2 + 1.0 / 362880.0;
+    p = p * x2 - 1.0 / 5040.0;
+    p = p * x2 + 1.0 / 120.0;
+    p = p * x2 - 1.0 / 6.0;
+    return x + x * x2 * p;
+}
+
+// cos(x) for |x| <= pi/2 :
+template <typename V>
+static inline V _cos(V x) {
+    return _sin(HALF_PI - (x < 0 ? -x : x));
+}
+
+// asin(x) for 0 <= x <= 0.5 : rational approximation of the cephes library
+template <typename V>
+static inline V _asin_small(V x) {
+    V z = x * x;
+    V p = _broadcast<V>(4.253011369004428248960E-3);
+    p = p * z - 6.019598008014123785661E-1;
+    p = p * z + 5.444622390564711410273E0;
+    p = p * z - 1.626247967210700244449E1;
+    p = p * z + 1.956261983317594739197E1;
+    p = p * z - 8.198089802484824371615E0;
+    V q = z - 1.474091372988853791896E1;
+    q = q * z + 7.049610280856842141659E1;
+    q = q * z - 1.471791292232726029859E2;
+    q = q * z + 1.395105614657485689735E2;
+    q = q * z - 4.918853881490881290097E1;
+    return x + x * (z * p / q);
+}
+
+// asin(x) for 0 <= x <= 1 : above 0.5, asin(x) = pi/2 - 2 * asin(sqrt((1 - x) / 2))
+template <typename V>
+static inline V _asin(V x) {
+    V reduced = _sqrt((1.0 - x) * 0.5);
+    V small = x > 0.5 ? reduced : x;
+    V asin_small = _asin_small(small);
+    return x > 0.5 ? HALF_PI - 2.0 * asin_small : asin_small;
+}
+
+// the longitude difference (in radians) brought back in [-pi, pi] (the distance doesn't change) :
+template <typename V>
+static inline V _delta_longitude(V lon1, V lon2) {
+    V delta = (lon1 - lon2) * DEG_TO_RAD;
+    delta = delta > PI ? delta - 2 * PI : delta;
+    return delta < -PI ? delta + 2 * PI : delta;
+}
+
+// same formula as osmium::geom::haversine::distance (the coordinates are in degrees) :
+template <typename V>
+static inline V _haversine(V lon1, V lat1, V lon2, V lat2) {
+    V lonh = _sin(_delta_longitude(lon1, lon2) * 0.5);
+    lonh = lonh * lonh;
+    V lath = _sin((lat1 - lat2) * DEG_TO_RAD * 0.5);
+    lath = lath * lath;
+    V tmp = _cos(lat1 * DEG_TO_RAD) * _cos(lat2 * DEG_TO_RAD);
+    V a = lath + tmp * lonh;
+    a = a > 1.0 ? _broadcast<V>(1.0) : a;  // (rounding errors could make it slightly greater than 1)
+    return 2.0 * EARTH_RADIUS_IN_METERS * _asin(_sqrt(a));
+}
+
+template <typename V>
+static inline V _equirectangular(V lon1, V lat1, V lon2, V lat2) {
+    V x = _delta_longitude(lon1, lon2) * _cos((lat1 + lat2) * (0.5 * DEG_TO_RAD));
+    V y = (lat1 - lat2) * DEG_TO_RAD;
+    return EARTH_RADIUS_IN_METERS * _sqrt(x * x + y * y);
+}
+
+// distances[i] = distance between (lon1[i], lat1[i]) and (lon2[i], lat2[i]), for i in [0, nb_padded_segments) :
+// nb_padded_segments must be a multiple of KERNEL_MAX_LANES (the padding lanes are computed too, and then ignored).
+template <typename V>
+static void _distances_kernel(double const* lon1,
+                              double const* lat1,
+                              double const* lon2,
+                              double const* lat2,
+                              size_t nb_padded_segments,
+                              double* distances,
+                              bool is_haversine) {
+    constexpr const size_t NB_LANES = sizeof(V) / sizeof(double);
+    static_assert(KERNEL_MAX_LANES % NB_LANES == 0);
+    for (size_t index = 0; index < nb_padded_segments; index += NB_LANES) {
+        V vlon1, vlat1, vlon2, vlat2;
+        __builtin_memcpy(&vlon1, lon1 + index, sizeof(V));
+        __builtin_memcpy(&vlat1, lat1 + index, sizeof(V));
+        __builtin_memcpy(&vlon2, lon2 + index, sizeof(V));
+        __builtin_memcpy(&vlat2, lat2 + index, sizeof(V));
+        V result = is_haversine ? _haversine(vlon1, vlat1, vlon2, vlat2) : _equirectangular(vlon1, vlat1, vlon2, vlat2);
+        __builtin_memcpy(distances + index, &result, sizeof(V));
+    }
+}
+
+}  // namespace uwpreprocess
@@ -1,62 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
 #include <boost/geometry.hpp>
-#include <osmium/geom/haversine.hpp>
 
+#include "graph/distances.h"
 #include "graph/extending_with_stops.h"
 
 using namespace std;
 
 namespace uwpreprocess {
 
-using BgDegree = boost::geometry::cs::spherical_equatorial<boost::geometry::degree>;
-using BgPoint = boost::geometry::model::point<double, 2, BgDegree>;
-using RtreeValue = pair<BgPoint, uwpreprocess::Node>;
-using RTree = boost::geometry::index::rtree<RtreeValue, boost::geometry::index::linear<8>>;
+// The nodes are indexed as 3D points on the unit sphere : the chord distance between two such points is a monotonic
+// function of their great-circle distance, so the closest node is the same, but is far cheaper to compute.
+using BgCartesianPoint = boost::geometry::model::point<double, 3, boost::geometry::cs::cartesian>;
+using RtreeValue = pair<BgCartesianPoint, uint32_t>;  // a node is identified by its index in the deduplicated nodes
+using RTree = boost::geometry::index::rtree<RtreeValue, boost::geometry::index::quadratic<16>>;
+
+static BgCartesianPoint _to_unit_sphere(double lon, double lat) {
+    double lon_rad = lon * M_PI / 180;
+    double lat_rad = lat * M_PI / 180;
+    return {cos(lat_rad) * cos(lon_rad), cos(lat_rad) * sin(lon_rad), sin(lat_rad)};
+}
+
+vector<uwpreprocess::Node> deduplicate_graph_nodes(vector<uwpreprocess::Edge> const& edges) {
+    vector<uwpreprocess::Node> nodes;
+    nodes.reserve(2 * edges.size());
+    for (auto const& edge : edges) {
+        nodes.push_back(edge.node_from);
+        nodes.push_back(edge.node_to);
+    }
+    // sorting by id makes the deduplication (and thus the index) independent of the order of the edges :
+    sort(nodes.begin(), nodes.end(), [](Node const& left, Node const& right) { return left.id < right.id; });
+    auto last = unique(nodes.begin(), nodes.end(), [](Node const& left, Node const& right) {
+        return left.id == right.id;
+    });
+    nodes.erase(last, nodes.end());
+    nodes.shrink_to_fit();
+    return nodes;
+}
+
+RTree index_graph_nodes(vector<uwpreprocess::Node> const& nodes) {
+    if (nodes.size() > numeric_limits<uint32_t>::max()) {
+        throw runtime_error("ERROR : too many nodes to index them with 32 bits indexes");
+    }
+    vector<RtreeValue> values;
+    values.reserve(nodes.size());
+    for (size_t node_index = 0; node_index < nodes.size(); ++node_index) {
+        values.emplace_back(_to_unit_sphere(nodes[node_index].lon(), nodes[node_index].lat()),
+                            static_cast<uint32_t>(node_index));
+    }
+    // the range constructor bulk-loads the rtree with the packing algorithm (STR), which is both faster to build,
+    // and gives a better tree than one-by-one insertions :
+    return RTree(values.begin(), values.end());
+}
+
+vector<uwpreprocess::Node> get_closest_nodes(RTree const& rtree,
+                                             vector<uwpreprocess::Node> const& nodes,
+                                             vector<Stop> const& stops,
+                                             size_t nb_threads) {
+    // the stops are split in contiguous chunks, each thread querying (read-only) the rtree for its own chunk :
+    vector<uint32_t> closest_node_indexes(stops.size());
+    auto snap_chunk = [&rtree, &stops, &closest_node_indexes](size_t first, size_t last) {
+        vector<RtreeValue> closest_values;
+        for (size_t stop_index = first; stop_index < last; ++stop_index) {
+            BgCartesianPoint stoppoint = _to_unit_sphere(stops[stop_index].lon, stops[stop_index].lat);
+            closest_values.clear();
+            rtree.query(boost::geometry::index::nearest(stoppoint, 1), back_inserter(closest_values));
+            closest_node_indexes[stop_index] = closest_values.front().second;
+        }
+    };
 
-RTree index_graph_nodes(vector<uwpreprocess::Edge> const& edges_osm) {
-    RTree rtree;
-    for (auto edge : edges_osm) {
-        // the fact that duplicate nodes are inserted doesn't change the final result, as duplicates have the same id.
-        rtree.insert(make_pair(BgPoint{edge.node_from.lon(), edge.node_from.lat()}, edge.node_from));
-        rtree.insert(make_pair(BgPoint{edge.node_to.lon(), edge.node_to.lat()}, edge.node_to));
+    nb_threads = max(size_t{1}, min(nb_threads, stops.size()));
+    size_t chunk_size = (stops.size() + nb_threads - 1) / nb_threads;
+    vector<thread> workers;
+    for (size_t first = 0; first < stops.size(); first += chunk_size) {
+        workers.emplace_back(snap_chunk, first, min(first + chunk_size, stops.size()));
     }
-    return rtree;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    vector<uwpreprocess::Node> closest_nodes;
+    closest_nodes.reserve(stops.size());
+    for (uint32_t node_index : closest_node_indexes) {
+        closest_nodes.push_back(nodes[node_index]);
+    }
+    return closest_nodes;
 }
 
-uwpreprocess::Node get_closest_node(RTree const& rtree, Stop const& stop) {
-    vector<RtreeValue> closest_nodes;
-    BgPoint stoppoint{stop.lon, stop.lat};
-    rtree.query(boost::geometry::index::nearest(stoppoint, 1), back_inserter(closest_nodes));
-    uwpreprocess::Node closest_node = closest_nodes.front().second;
-    return closest_node;
+static double _chord_distance(BgCartesianPoint const& left, BgCartesianPoint const& right) {
+    return boost::geometry::distance(left, right);
 }
 
-pair<vector<uwpreprocess::Edge>, vector<uwpreprocess::StopWithClosestNode>> extend_graph(vector<Stop> const& stops,
-                                                                     vector<uwpreprocess::Edge> const& edges_osm,
-                                                                     float walkspeed_km_per_h) {
-    // note : this is currently done in multiple steps (+ copies) for code clarity
-    //        but if performance is an issue, we could easily do better
+// The stops that kept their location are snapped to the closest among their previous closest node (if it still exists
+// at the same location) and the changed nodes. The other stops are returned, as they must be snapped on the whole graph.
+static vector<size_t> _snap_from_previous(vector<Stop> const& stops,
+                                          vector<uwpreprocess::Node> const& nodes,
+                                          PreviousSnapping const& previous_snapping,
+                                          vector<uwpreprocess::Node>& closest_nodes) {
+    vector<uwpreprocess::Node> const& changed_nodes = previous_snapping.changed_nodes;
+    RTree changed_rtree = index_graph_nodes(changed_nodes);
 
-    // index all nodes in graph :
-    RTree rtree = index_graph_nodes(edges_osm);
+    vector<size_t> unsnapped_stops;
+    vector<RtreeValue> closest_values;
+    for (size_t stop_index = 0; stop_index < stops.size(); ++stop_index) {
+        auto const& stop = stops[stop_index];
+        auto previous = previous_snapping.stops.find(stop.id);
+        if (previous == previous_snapping.stops.end() || previous->second.stop_lon != stop.lon ||
+            previous->second.stop_lat != stop.lat) {
+            unsnapped_stops.push_back(stop_index);
+            continue;
+        }
+        Node const& previous_node = previous->second.closest_node;
+        auto found = lower_bound(nodes.begin(), nodes.end(), previous_node.id,
+                                 [](Node const& node, NodeId id) { return node.id < id; });
+        if (found == nodes.end() || found->id != previous_node.id || found->location != previous_node.location) {
+            unsnapped_stops.push_back(stop_index);
+            continue;
+        }
+
+        // the previous closest node is still the closest of the unchanged nodes :
+        closest_nodes[stop_index] = *found;
+        if (changed_nodes.empty())
+            continue;
+        BgCartesianPoint stoppoint = _to_unit_sphere(stop.lon, stop.lat);
+        closest_values.clear();
+        changed_rtree.query(boost::geometry::index::nearest(stoppoint, 1), back_inserter(closest_values));
+        if (_chord_distance(stoppoint, closest_values.front().first) <
+            _chord_distance(stoppoint, _to_unit_sphere(found->lon(), found->lat()))) {
+            closest_nodes[stop_index] = changed_nodes[closest_values.front().second];
+        }
+    }
+    return unsnapped_stops;
+}
+
+vector<uwpreprocess::StopWithClosestNode> extend_graph(vector<Stop> const& stops,
+                                                       vector<uwpreprocess::Edge>& edges,
+                                                       float walkspeed_km_per_h,
+                                                       NodeNames& node_names,
+                                                       GeometryArena& geometries,
+                                                       PreviousSnapping const* previous_snapping,
+                                                       size_t nb_threads) {
+    // index all nodes in graph, and find the closest node of each stop :
+    vector<uwpreprocess::Node> closest_nodes;
+    if (!stops.empty()) {
+        vector<uwpreprocess::Node> nodes = deduplicate_graph_nodes(edges);
+        if (previous_snapping == nullptr) {
+            RTree rtree = index_graph_nodes(nodes);
+            closest_nodes = get_closest_nodes(rtree, nodes, stops, nb_threads);
+        } else {
+            // only the stops that can't reuse their previous snapping need the index of the whole graph :
+            closest_nodes.assign(stops.size(), Node{0, osmium::Location{}});
+            vector<size_t> unsnapped_stops = _snap_from_previous(stops, nodes, *previous_snapping, closest_nodes);
+            cout << "Number of stops snapped again on the whole graph = " << unsnapped_stops.size() << " / "
+                 << stops.size() << endl;
+            if (!unsnapped_stops.empty()) {
+                vector<Stop> stops_to_snap;
+                for (size_t stop_index : unsnapped_stops) {
+                    stops_to_snap.push_back(stops[stop_index]);
+                }
+                RTree rtree = index_graph_nodes(nodes);
+                vector<uwpreprocess::Node> snapped = get_closest_nodes(rtree, nodes, stops_to_snap, nb_threads);
+                for (size_t index = 0; index < unsnapped_stops.size(); ++index) {
+                    closest_nodes[unsnapped_stops[index]] = snapped[index];
+                }
+            }
+        }
+    }
+
+    // the stop edges are appended in place (the room for the reversed edges, that are added afterwards, is reserved
+    // at the same time, so that the edges are reallocated only once) :
+    edges.reserve(2 * (edges.size() + stops.size()));
+
+    // the lengths of the stop edges are computed all at once (by the vectorized distance kernel) :
+    vector<osmium::Location> stop_locations;
+    vector<osmium::Location> closest_locations;
+    stop_locations.reserve(stops.size());
+    closest_locations.reserve(stops.size());
+    for (size_t stop_index = 0; stop_index < stops.size(); ++stop_index) {
+        stop_locations.emplace_back(stops[stop_index].lon, stops[stop_index].lat);
+        closest_locations.push_back(closest_nodes[stop_index].location);
+    }
+    vector<double> stop_edge_lengths(stops.size());
+    distances_in_meters(stop_locations.data(), closest_locations.data(), stops.size(), stop_edge_lengths.data());
 
-    // for each stop, find closest node in graph, and adds an edge from stop to closest node :
-    vector<uwpreprocess::Edge> edges_extended_with_stops = edges_osm;
+    // for each stop, adds an edge from stop to its closest node :
     vector<uwpreprocess::StopWithClosestNode> stops_with_closest_node;
-    for (auto& stop : stops) {
-        uwpreprocess::Node closest_node = get_closest_node(rtree, stop);
+    stops_with_closest_node.reserve(stops.size());
+    for (size_t stop_index = 0; stop_index < stops.size(); ++stop_index) {
+        auto const& stop = stops[stop_index];
+        auto const& closest_node = closest_nodes[stop_index];
 
         // we now extend graph with a straight edge from stop to closest node :
-        uwpreprocess::Polyline geometry{{stop.lon, stop.lat}, {closest_node.lon(), closest_node.lat()}};
-        float distance_in_meters = osmium::geom::haversine::distance(geometry.front(), geometry.back());
+        float distance_in_meters = stop_edge_lengths[stop_index];
         auto walkspeed_m_per_second = walkspeed_km_per_h * 1000 / 3600;
         float weight_in_seconds = distance_in_meters / walkspeed_m_per_second;
-        edges_extended_with_stops.emplace_back(stop.id, Node::UNRANKED, closest_node.id, Node::UNRANKED,
-                                            std::move(geometry), distance_in_meters, weight_in_seconds);
+        GeometryView geometry = geometries.add({stop_locations[stop_index], closest_node.location});
+        edges.emplace_back(node_names.add_stop(stop.id), Node::UNRANKED, closest_node.id, Node::UNRANKED, geometries,
+                           geometry, distance_in_meters, weight_in_seconds);
 
         // for each stop, we memorize the closest node :
-        stops_with_closest_node.emplace_back(stop, closest_node.id, closest_node.url);
+        stops_with_closest_node.emplace_back(stop, closest_node.id);
     }
-    return {edges_extended_with_stops, stops_with_closest_node};
+    return stops_with_closest_node;
 }
 
 }  // namespace uwpreprocess
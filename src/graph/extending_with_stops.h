@@ -1,5 +1,7 @@
 #pragma once
 
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "graph/types.h"
@@ -7,8 +9,27 @@
 
 namespace uwpreprocess {
 
-std::pair<std::vector<Edge>, std::vector<StopWithClosestNode>> extend_graph(std::vector<Stop> const& stops,
-                                                                            std::vector<Edge> const& edges_osm,
-                                                                            float walkspeed_km_per_h);
+// The snapping of a previous build, and the graph nodes that may have appeared or moved since then.
+// The closest node of a stop is then the closest among its previous closest node and the changed nodes : only the stops
+// that moved, or whose previous closest node disappeared or moved, need to be snapped on the whole graph again.
+struct PreviousSnapping {
+    struct Snapped {
+        double stop_lon;
+        double stop_lat;
+        Node closest_node;
+    };
+
+    std::unordered_map<StopId, Snapped> stops;
+    std::vector<Node> changed_nodes;
+};
+
+// extends the edges (in place) with an edge between each stop and its closest node, and returns those closest nodes :
+std::vector<StopWithClosestNode> extend_graph(std::vector<Stop> const& stops,
+                                              std::vector<Edge>& edges,
+                                              float walkspeed_km_per_h,
+                                              NodeNames& node_names,
+                                              GeometryArena& geometries,
+                                              PreviousSnapping const* previous_snapping = nullptr,
+                                              size_t nb_threads = std::thread::hardware_concurrency());
 
 }
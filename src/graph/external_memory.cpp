@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+
+#include <unistd.h>
+
+#include "graph/external_memory.h"
+#include "graph/graph.h"
+#include "graph/memory_accounting.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+// Run files are plain sequences of records :
+//  - way run   : [way_id][buffer_rank][speed_factor][nb_nodes] then nb_nodes times [node_id][location], sorted by
+//                (way_id, buffer_rank)
+//  - count run : [node_id][count], sorted by node_id (each node appears once)
+
+template <typename T>
+static void _write(ostream& out, T const& value) {
+    static_assert(is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+// returns false at the end of the run :
+template <typename T>
+static bool _read(istream& in, T& value) {
+    static_assert(is_trivially_copyable_v<T>);
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if (in.gcount() == 0 && in.eof())
+        return false;
+    if (!in)
+        throw runtime_error("ERROR : truncated run file");
+    return true;
+}
+
+// same, for a value that can't be the first one of a record (thus, the end of the file is a truncation) :
+template <typename T>
+static void _read_required(istream& in, T& value) {
+    if (!_read(in, value))
+        throw runtime_error("ERROR : truncated run file");
+}
+
+static void _close_run(ofstream& out, filesystem::path const& run) {
+    out.close();
+    if (!out)
+        throw runtime_error("ERROR : unable to write run file : " + run.string());
+}
+
+// the run files live in their own directory, removed at the end (even if the build fails) :
+struct TemporaryDirectory {
+    explicit TemporaryDirectory(filesystem::path path_) : path{move(path_)} { filesystem::create_directories(path); }
+    ~TemporaryDirectory() {
+        error_code ignored;
+        filesystem::remove_all(path, ignored);
+    }
+    filesystem::path path;
+};
+
+// Each parsing thread accumulates its chunks of ways, and spills them as a pair of sorted runs (ways + node usage) as
+// soon as they exceed its share of the memory budget :
+class ShardSpiller {
+   public:
+    ShardSpiller(filesystem::path dir_, size_t thread_index_, size_t budget_bytes_)
+        : dir{move(dir_)}, thread_index{thread_index_}, budget_bytes{budget_bytes_} {}
+
+    void add(size_t buffer_rank, WaysNodes&& chunk) {
+        nb_bytes += chunk.nodes.size() * (sizeof(LocatedNode) + sizeof(NodeOsmId)) +
+                    chunk.size() * (sizeof(WayId) + sizeof(float) + sizeof(size_t));
+        chunks.emplace_back(buffer_rank, move(chunk));
+        if (nb_bytes >= budget_bytes)
+            spill();
+    }
+
+    void spill() {
+        if (chunks.empty())
+            return;
+        spill_ways();
+        spill_node_usage();
+        chunks.clear();
+        nb_bytes = 0;
+        ++nb_spills;
+    }
+
+    vector<filesystem::path> way_runs;
+    vector<filesystem::path> count_runs;
+
+   private:
+    filesystem::path next_run(string const& kind) const {
+        return dir / (kind + "-" + to_string(thread_index) + "-" + to_string(nb_spills) + ".run");
+    }
+
+    void spill_ways() {
+        struct WayRef {
+            WayId way_id;
+            size_t buffer_rank;
+            WaysNodes const* chunk;
+            size_t way_index;
+        };
+        vector<WayRef> refs;
+        for (auto const& [buffer_rank, chunk] : chunks) {
+            for (size_t way_index = 0; way_index < chunk.size(); ++way_index) {
+                refs.push_back({chunk.way_ids[way_index], buffer_rank, &chunk, way_index});
+            }
+        }
+        // (stable : within a buffer, the ways stay in the file order)
+        stable_sort(refs.begin(), refs.end(), [](WayRef const& left, WayRef const& right) {
+            return left.way_id < right.way_id || (left.way_id == right.way_id && left.buffer_rank < right.buffer_rank);
+        });
+
+        filesystem::path run = next_run("ways");
+        ofstream out(run, ios::binary);
+        for (auto const& ref : refs) {
+            WayNodes nodes = ref.chunk->way_nodes(ref.way_index);
+            _write(out, ref.way_id);
+            _write(out, static_cast<uint64_t>(ref.buffer_rank));
+            _write(out, ref.chunk->speed_factors[ref.way_index]);
+            _write(out, static_cast<uint64_t>(nodes.size()));
+            for (auto const& [node_id, location] : nodes) {
+                _write(out, node_id);
+                _write(out, location);
+            }
+        }
+        _close_run(out, run);
+        way_runs.push_back(run);
+    }
+
+    void spill_node_usage() {
+        vector<NodeOsmId> node_ids;
+        for (auto const& [_, chunk] : chunks) {
+            for (auto const& located_node : chunk.nodes) {
+                node_ids.push_back(located_node.first);
+            }
+        }
+        sort(node_ids.begin(), node_ids.end());
+
+        filesystem::path run = next_run("counts");
+        ofstream out(run, ios::binary);
+        for (auto first = node_ids.begin(); first != node_ids.end();) {
+            auto last = upper_bound(first, node_ids.end(), *first);
+            _write(out, *first);
+            _write(out, static_cast<uint32_t>(last - first));
+            first = last;
+        }
+        _close_run(out, run);
+        count_runs.push_back(run);
+    }
+
+    filesystem::path dir;
+    size_t thread_index;
+    size_t budget_bytes;
+    vector<pair<size_t, WaysNodes>> chunks;
+    size_t nb_bytes = 0;
+    size_t nb_spills = 0;
+};
+
+// k-way merge of the node usage runs : returns a counter of the nodes used at least twice (only the splitting threshold
+// matters to build the edges, thus the counts are capped to 2)
+static NodeUseCounter _merge_node_usage(vector<filesystem::path> const& runs) {
+    struct Head {
+        NodeOsmId node_id;
+        uint32_t count;
+        size_t run_index;
+        bool operator>(Head const& other) const { return node_id > other.node_id; }
+    };
+    vector<ifstream> ins;
+    ins.reserve(runs.size());
+    priority_queue<Head, vector<Head>, greater<Head>> heads;
+    for (size_t run_index = 0; run_index < runs.size(); ++run_index) {
+        ins.emplace_back(runs[run_index], ios::binary);
+        Head head{0, 0, run_index};
+        if (_read(ins.back(), head.node_id)) {
+            _read_required(ins.back(), head.count);
+            heads.push(head);
+        }
+    }
+
+    NodeUseCounter shared_nodes;
+    while (!heads.empty()) {
+        NodeOsmId node_id = heads.top().node_id;
+        uint32_t count = 0;
+        while (!heads.empty() && heads.top().node_id == node_id) {
+            Head head = heads.top();
+            heads.pop();
+            count += head.count;
+            if (_read(ins[head.run_index], head.node_id)) {
+                _read_required(ins[head.run_index], head.count);
+                heads.push(head);
+            }
+        }
+        if (count >= 2)
+            shared_nodes.increment(node_id, 2);
+    }
+    return shared_nodes;
+}
+
+// k-way merge of the way runs : calls function(way_nodes, speed_factor) for each way, by increasing way id (if a way id is
+// duplicated, only its first occurrence in the file is kept, as in WaysNodes::ordered_by_way_id)
+template <typename Function>
+static void _merge_ways(vector<filesystem::path> const& runs, Function function) {
+    struct Head {
+        WayId way_id;
+        uint64_t buffer_rank;
+        float speed_factor;
+        size_t run_index;
+        bool operator>(Head const& other) const {
+            return way_id > other.way_id || (way_id == other.way_id && buffer_rank > other.buffer_rank);
+        }
+    };
+    vector<ifstream> ins;
+    ins.reserve(runs.size());
+    vector<vector<LocatedNode>> nodes(runs.size());  // the nodes of the current way of each run
+    auto read_way = [&ins, &nodes](Head& head) -> bool {
+        istream& in = ins[head.run_index];
+        uint64_t nb_nodes;
+        if (!_read(in, head.way_id))
+            return false;
+        _read_required(in, head.buffer_rank);
+        _read_required(in, head.speed_factor);
+        _read_required(in, nb_nodes);
+        auto& way_nodes = nodes[head.run_index];
+        way_nodes.clear();
+        for (uint64_t node_index = 0; node_index < nb_nodes; ++node_index) {
+            NodeOsmId node_id;
+            osmium::Location location;
+            _read_required(in, node_id);
+            _read_required(in, location);
+            way_nodes.emplace_back(node_id, location);
+        }
+        return true;
+    };
+
+    priority_queue<Head, vector<Head>, greater<Head>> heads;
+    for (size_t run_index = 0; run_index < runs.size(); ++run_index) {
+        ins.emplace_back(runs[run_index], ios::binary);
+        Head head{0, 0, 1, run_index};
+        if (read_way(head))
+            heads.push(head);
+    }
+
+    bool is_first_way = true;
+    WayId previous_way_id = 0;
+    while (!heads.empty()) {
+        Head head = heads.top();
+        heads.pop();
+        if (is_first_way || head.way_id != previous_way_id) {
+            auto const& way_nodes = nodes[head.run_index];
+            function(WayNodes{way_nodes.data(), way_nodes.data() + way_nodes.size()}, head.speed_factor);
+        }
+        is_first_way = false;
+        previous_way_id = head.way_id;
+        if (read_way(head))
+            heads.push(head);
+    }
+}
+
+vector<Edge> osm_to_graph_external(string const& osmfile,
+                                   BgPolygon const& polygon,
+                                   float walkspeed_km_per_h,
+                                   GeometryArena& geometries,
+                                   ExternalMemoryOptions const& options,
+                                   size_t nb_threads) {
+    nb_threads = max(nb_threads, size_t{1});
+    TemporaryDirectory runs_dir{options.temporary_dir / ("uwpreprocess-runs-" + to_string(::getpid()))};
+    cout << "External-memory build : memory budget = " << options.memory_budget_bytes / (1024 * 1024)
+         << " MB, run files in " << runs_dir.path << endl;
+
+    // parsing, the ways being spilled to sorted runs :
+    constexpr const size_t MIN_THREAD_BUDGET_BYTES = 1024 * 1024;
+    size_t thread_budget_bytes = max(MIN_THREAD_BUDGET_BYTES, options.memory_budget_bytes / nb_threads);
+    vector<ShardSpiller> spillers;
+    for (size_t thread_index = 0; thread_index < nb_threads; ++thread_index) {
+        spillers.emplace_back(runs_dir.path, thread_index, thread_budget_bytes);
+    }
+    stream_osm_ways(osmfile, {polygon}, nb_threads, [&spillers](size_t thread_index, size_t, size_t buffer_rank,
+                                                                 WaysNodes&& chunk) {
+        spillers[thread_index].add(buffer_rank, move(chunk));
+    });
+    vector<filesystem::path> way_runs;
+    vector<filesystem::path> count_runs;
+    for (auto& spiller : spillers) {
+        spiller.spill();
+        way_runs.insert(way_runs.end(), spiller.way_runs.begin(), spiller.way_runs.end());
+        count_runs.insert(count_runs.end(), spiller.count_runs.begin(), spiller.count_runs.end());
+    }
+    spillers.clear();
+    cout << "Number of run files = " << way_runs.size() << " (ways) + " << count_runs.size() << " (node usage)" << endl;
+
+    // the nodes shared by several ways :
+    NodeUseCounter shared_nodes = _merge_node_usage(count_runs);
+    cout << "Number of nodes shared by several ways = " << shared_nodes.size() << endl;
+    print_memory_usage("node usage merge");
+
+    // streaming the ways by increasing id, and splitting them into edges :
+    vector<Edge> edges;
+    float walkspeed_m_per_s = walkspeed_km_per_h / 3.6;
+    _merge_ways(way_runs, [&shared_nodes, walkspeed_m_per_s, &geometries, &edges](WayNodes const& way_nodes,
+                                                                                   float speed_factor) {
+        build_way_edges(way_nodes, shared_nodes, walkspeed_m_per_s * speed_factor, geometries, edges);
+    });
+    print_memory_usage("graph building");
+    return edges;
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "graph/graphtypes.h"
+#include "graph/polygon.h"
+
+namespace uwpreprocess {
+
+// External-memory (out-of-core) build of the OSM graph, for the extracts whose ways don't fit in memory :
+//  - the located ways, and the usage of their nodes, are spilled to sorted run files, as soon as the parsed ways exceed
+//    the memory budget
+//  - the node usage runs are merged (k-way merge) to find the nodes shared by several ways : they are the only
+//    per-node data kept in memory
+//  - the way runs are merged (k-way merge) by way id, each way being split into edges as soon as it is read
+// The edges are the same as those of osm_to_graph.
+// Note : the budget bounds the parsed ways, but neither the location index of the nodes (which is a file-backed mmap
+// for large extracts), nor the resulting edges and geometries.
+struct ExternalMemoryOptions {
+    size_t memory_budget_bytes;
+    std::filesystem::path temporary_dir = std::filesystem::temp_directory_path();  // the run files are removed at the end
+};
+
+std::vector<Edge> osm_to_graph_external(std::string const& osmfile,
+                                        BgPolygon const& polygon,
+                                        float walkspeed_km_per_h,
+                                        GeometryArena& geometries,  // filled with the geometries of the edges
+                                        ExternalMemoryOptions const& options,
+                                        size_t nb_threads = std::thread::hardware_concurrency());
+
+}  // namespace uwpreprocess
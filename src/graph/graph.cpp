@@ -1,43 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <osmium/io/any_input.hpp>
 #include <osmium/visitor.hpp>
+#include <osmium/index/map/sparse_mem_array.hpp>
 #include <osmium/index/map/sparse_mmap_array.hpp>
-#include <osmium/handler/node_locations_for_ways.hpp>
-#include <osmium/geom/haversine.hpp>
+#include <osmium/index/map/dense_mmap_array.hpp>
 
+#include "graph/distances.h"
 #include "graph/osmparsing.h"
+#include "common/parallel.h"
 #include "graph/graph.h"
+#include "graph/memory_accounting.h"
 
 using namespace std;
 
 namespace uwpreprocess {
 
-float geometry_length_in_meters(Polyline const& geometry) {
-    // precondition = polyline has at least 2 points
-    Polyline::const_iterator first = geometry.begin();
-    Polyline::const_iterator second = first + 1;
-
-    float total_length = 0;
-    while (second != geometry.end()) {
-        total_length += osmium::geom::haversine::distance(*first, *second);
-        ++first;
-        ++second;
-    }
-    return total_length;
-}
-
 static void add_edge(vector<Edge>& edges,
                      osmium::object_id_type node_from,
                      osmium::object_id_type node_to,
-                     Polyline&& geometry,
+                     GeometryArena& geometries,
                      float walkspeed_m_per_s) {
-    float length_m = geometry_length_in_meters(geometry);
+    // the geometry of the edge is made of the locations pushed in the arena since the last edge :
+    GeometryView geometry = geometries.close_polyline();
+    float length_m = polyline_length_in_meters(geometries.locations.data() + geometry.offset, geometry.length);
     float weight = length_m / walkspeed_m_per_s;
-    edges.emplace_back(node_from, node_to, std::move(geometry), length_m, weight);
+    edges.emplace_back(node_from, node_to, geometries, geometry, length_m, weight);
 }
 
-std::vector<Edge> build_graph(std::map<WayId, std::vector<LocatedNode> > const& way_to_nodes,
-                              std::map<NodeOsmId, int> const& number_of_node_usage,
-                              float walkspeed_km_per_h) {
+void build_way_edges(WayNodes const& nodes,
+                     NodeUseCounter const& number_of_node_usage,
+                     float walkspeed_m_per_s,
+                     GeometryArena& geometries,
+                     vector<Edge>& edges) {
+    // precondition = the way has at least 2 nodes
+    auto first_node = nodes.begin();
+    auto last_node = (nodes.end() - 1);
+    while (first_node != last_node) {
+        auto second_node = (first_node + 1);
+        geometries.push_back(first_node->second);
+
+        // note : pour ne pas laisser de côté les impasses, il faut obligatoirement ajouter le premier et dernier
+        // node, même s'ils ont un compteur à 1
+
+        // skipping all nodes that only belong to this way :
+        while (second_node != nodes.end() && number_of_node_usage.count(second_node->first) < 2) {
+            geometries.push_back(second_node->second);
+            ++second_node;
+        }
+
+        // à ce stade, second_node pointe vers le premier node (après first_node) qui a un compteur >= 2
+        // (ou bien vers end() s'il n'y en avait pas, ce qui veut dire que la way était une impasse se finissant sur
+        // le dernier noeud)
+
+        // si second_node est à end, c'est que le dernier node de la way n'avait pas un compteur >= 2
+        // Dit autrement : la way était une impasse, se terminant sur second_node.
+        // Dans ce cas, on ajoute l'edge, et on a fini pour cette way :
+        if (second_node == nodes.end()) {
+            add_edge(edges, first_node->first, (second_node - 1)->first, geometries, walkspeed_m_per_s);
+            break;
+        }
+
+        // cas général : on ajoute le subedge, et on continue d'itérer sur la way :
+        geometries.push_back(second_node->second);
+        add_edge(edges, first_node->first, second_node->first, geometries, walkspeed_m_per_s);
+        first_node = second_node;
+
+        // NOTE : quoi qu'il arrive, on aura au moins un edge ajouté contenant le premier node, et un edge ajouté
+        // contenant le dernier node (qui pourra ou non être le même).
+    }
+}
+
+// A tile of the spatial partition of the ways : its edges are built by a single worker, in its own edge list and arena.
+struct _Tile {
+    vector<size_t> way_ranks;  // ranks of the ways of the tile in the serial order (thus, in ascending order)
+    vector<Edge> edges;
+    GeometryArena geometries;
+};
+
+// each way goes to the tile of its first node, in a grid of side x side tiles covering the bounding box of the ways :
+static vector<_Tile> _partition_ways_in_tiles(WaysNodes const& ways_nodes,
+                                              vector<size_t> const& ordered_ways,
+                                              size_t side) {
+    int64_t min_x = numeric_limits<int32_t>::max(), min_y = numeric_limits<int32_t>::max();
+    int64_t max_x = numeric_limits<int32_t>::min(), max_y = numeric_limits<int32_t>::min();
+    for (size_t way_index : ordered_ways) {
+        osmium::Location const& location = ways_nodes.way_nodes(way_index).begin()->second;
+        min_x = min<int64_t>(min_x, location.x());
+        max_x = max<int64_t>(max_x, location.x());
+        min_y = min<int64_t>(min_y, location.y());
+        max_y = max<int64_t>(max_y, location.y());
+    }
+
+    vector<_Tile> tiles(side * side);
+    for (size_t way_rank = 0; way_rank < ordered_ways.size(); ++way_rank) {
+        osmium::Location const& location = ways_nodes.way_nodes(ordered_ways[way_rank]).begin()->second;
+        size_t column = static_cast<size_t>((location.x() - min_x) * static_cast<int64_t>(side) / (max_x - min_x + 1));
+        size_t row = static_cast<size_t>((location.y() - min_y) * static_cast<int64_t>(side) / (max_y - min_y + 1));
+        tiles[row * side + column].way_ranks.push_back(way_rank);
+    }
+    return tiles;
+}
+
+// The ways are partitioned in spatial tiles, and the edges of each tile are built by its own worker (most of the time
+// is spent in the computation of the edge lengths, that is independent from one way to another).
+// A way is split at its nodes used by several ways, which only depends on the (shared, read-only) node use counter :
+// thus, a way crossing a tile boundary is split exactly as in a serial build, and a boundary node keeps the same id in
+// all the tiles that use it, without any further reconciliation.
+// The tiles are then stitched : the edges and the geometry of each way are moved to the position they have in the
+// serial build (ways by increasing id), which makes the result bit-identical to the serial build, whatever the number
+// of threads (the ranks of the nodes, given later by the walking-graph, depend on this order).
+// NOTE : during the stitching, the edges and geometries are held twice (in the tiles, and in the stitched output).
+static vector<Edge> _build_graph_in_tiles(WaysNodes const& ways_nodes,
+                                          vector<size_t> const& ordered_ways,
+                                          NodeUseCounter const& number_of_node_usage,
+                                          float walkspeed_m_per_s,
+                                          GeometryArena& geometries,
+                                          size_t nb_threads) {
+    // a few tiles per thread, to balance the load between dense and sparse areas :
+    constexpr const size_t TILES_PER_THREAD = 4;
+    size_t side = static_cast<size_t>(ceil(sqrt(static_cast<double>(TILES_PER_THREAD * nb_threads))));
+    vector<_Tile> tiles = _partition_ways_in_tiles(ways_nodes, ordered_ways, side);
+
+    vector<size_t> way_nb_edges(ordered_ways.size());
+    vector<size_t> way_nb_locations(ordered_ways.size());
+    parallel_for(tiles.size(), nb_threads, [&](size_t, size_t tile_index) {
+        _Tile& tile = tiles[tile_index];
+        for (size_t way_rank : tile.way_ranks) {
+            size_t nb_edges_before = tile.edges.size();
+            size_t nb_locations_before = tile.geometries.locations.size();
+            size_t way_index = ordered_ways[way_rank];
+            build_way_edges(ways_nodes.way_nodes(way_index), number_of_node_usage,
+                            walkspeed_m_per_s * ways_nodes.speed_factors[way_index], tile.geometries, tile.edges);
+            way_nb_edges[way_rank] = tile.edges.size() - nb_edges_before;
+            way_nb_locations[way_rank] = tile.geometries.locations.size() - nb_locations_before;
+        }
+    }, 1);
+
+    // stitching : position of the edges and locations of each way in the serial build
+    // (precondition = the geometries arena has no pending polyline, as the edges are appended after its content)
+    vector<size_t> way_first_edge(ordered_ways.size() + 1, 0);
+    vector<size_t> way_first_location(ordered_ways.size() + 1, geometries.locations.size());
+    for (size_t way_rank = 0; way_rank < ordered_ways.size(); ++way_rank) {
+        way_first_edge[way_rank + 1] = way_first_edge[way_rank] + way_nb_edges[way_rank];
+        way_first_location[way_rank + 1] = way_first_location[way_rank] + way_nb_locations[way_rank];
+    }
+    if (way_first_edge.back() == 0) {
+        return {};
+    }
+
+    // (Edge has no default constructor : the stitched edges are first filled with copies of an arbitrary edge)
+    auto first_filled_tile =
+        find_if(tiles.cbegin(), tiles.cend(), [](_Tile const& tile) { return !tile.edges.empty(); });
+    vector<Edge> edges(way_first_edge.back(), first_filled_tile->edges.front());
+    vector<osmium::Location> locations = move(geometries.locations);
+    locations.resize(way_first_location.back());
+    parallel_for(tiles.size(), nb_threads, [&](size_t, size_t tile_index) {
+        _Tile& tile = tiles[tile_index];
+        size_t tile_edge = 0;
+        size_t tile_location = 0;
+        for (size_t way_rank : tile.way_ranks) {
+            size_t first_location = way_first_location[way_rank];
+            for (size_t edge_rank = way_first_edge[way_rank]; edge_rank < way_first_edge[way_rank + 1]; ++edge_rank) {
+                Edge& edge = edges[edge_rank];
+                edge = tile.edges[tile_edge++];
+                edge.geometry.offset = edge.geometry.offset - tile_location + first_location;
+            }
+            copy_n(tile.geometries.locations.cbegin() + tile_location, way_nb_locations[way_rank],
+                   locations.begin() + first_location);
+            tile_location += way_nb_locations[way_rank];
+        }
+        tile = _Tile{};  // the tile is released as soon as it is stitched
+    }, 1);
+    geometries.assign(move(locations));
+    return edges;
+}
+
+std::vector<Edge> build_graph(WaysNodes const& ways_nodes,
+                              NodeUseCounter const& number_of_node_usage,
+                              float walkspeed_km_per_h,
+                              GeometryArena& geometries,
+                              size_t nb_threads) {
     vector<Edge> edges;
     float walkspeed_m_per_s = walkspeed_km_per_h / 3.6;
 
@@ -45,7 +197,7 @@ std::vector<Edge> build_graph(std::map<WayId, std::vector<LocatedNode> > const&
 
     // L'objectif de ce code est de splitter en plusieurs edges les ways OSM qui sont intersectées en leur milieu
     // par d'autres ways. On utilise pour cela :
-    //      way_to_nodes qui permet à partir d'une way de retrouver ses nodes
+    //      ways_nodes qui permet à partir d'une way de retrouver ses nodes
     //      number_of_node_usage qui permet à partir d'un node de savoir combien de ways l'utilisent
     // Illustration de situation (au 19 avril 2021) où ce split est nécessaire :
     //      - la Rue de Gabian (way OSM d'id 158189827) est intersectée en son milieu par la Rue de l'Industrie (way OSM
@@ -58,65 +210,281 @@ std::vector<Edge> build_graph(std::map<WayId, std::vector<LocatedNode> > const&
     //      l'Industrie (node OSM d'id 2825675780) :
     //              https://www.openstreetmap.org/node/2825675780
 
-    for (auto ite : way_to_nodes) {
-        auto nodes = ite.second;
+    // les ways sont parcourues par id croissant (les nodes sont parcourus en place, sans copie) :
+    vector<size_t> ordered_ways = ways_nodes.ordered_by_way_id();
+    if (nb_threads > 1 && !ordered_ways.empty()) {
+        return _build_graph_in_tiles(ways_nodes, ordered_ways, number_of_node_usage, walkspeed_m_per_s,
+                                     geometries, nb_threads);
+    }
+    for (size_t way_index : ordered_ways) {
+        build_way_edges(ways_nodes.way_nodes(way_index), number_of_node_usage,
+                        walkspeed_m_per_s * ways_nodes.speed_factors[way_index], geometries, edges);
+    }
+
+    return edges;
+}
+
+using LocationIndex = osmium::index::map::Map<osmium::unsigned_object_id_type, osmium::Location>;
+
+static unique_ptr<LocationIndex> _create_location_index(string const& osmfile) {
+    // the index backend is chosen from the extract size :
+    //  - small extracts (cities, regions) : a sparse in-memory array is the most compact
+    //  - large extracts (countries) : a sparse mmap array, that grows without the copy-peak of a std::vector
+    //  - huge extracts (continents, planet) : so many nodes are kept that a dense array (indexed by id) is smaller
+    constexpr const uintmax_t ONE_GIGABYTE = 1024 * 1024 * 1024;
+    uintmax_t osmfile_size = filesystem::file_size(osmfile);
+    if (osmfile_size < 1 * ONE_GIGABYTE) {
+        cout << "Using location index 'sparse_mem_array'" << endl;
+        return make_unique<osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location>>();
+    }
+    if (osmfile_size < 30 * ONE_GIGABYTE) {
+        cout << "Using location index 'sparse_mmap_array'" << endl;
+        return make_unique<osmium::index::map::SparseMmapArray<osmium::unsigned_object_id_type, osmium::Location>>();
+    }
+    cout << "Using location index 'dense_mmap_array'" << endl;
+    return make_unique<osmium::index::map::DenseMmapArray<osmium::unsigned_object_id_type, osmium::Location>>();
+}
 
-        auto first_node = nodes.begin();
-        auto last_node = (nodes.end() - 1);
-        while (first_node != last_node) {
-            auto second_node = (first_node + 1);
-            Polyline geometry{first_node->second};
+// A bounded queue, used to hand-out the decoded buffers to the worker threads :
+class BufferQueue {
+   public:
+    explicit BufferQueue(size_t max_size_) : max_size{max_size_} {}
 
-            // note : pour ne pas laisser de côté les impasses, il faut obligatoirement ajouter le premier et dernier
-            // node, même s'ils ont un compteur à 1
+    // each buffer is pushed along with its rank (= its position in the file) :
+    void push(size_t buffer_rank, osmium::memory::Buffer&& buffer) {
+        unique_lock<mutex> lock{mut};
+        not_full.wait(lock, [this]() { return buffers.size() < max_size; });
+        buffers.emplace_back(buffer_rank, move(buffer));
+        not_empty.notify_one();
+    }
+
+    // once closed, no buffer can be pushed anymore, and pop returns false when the queue is empty :
+    void close() {
+        lock_guard<mutex> lock{mut};
+        is_closed = true;
+        not_empty.notify_all();
+    }
 
-            // skipping all nodes that only belong to this way :
-            while (second_node != nodes.end() && number_of_node_usage.at(second_node->first) < 2) {
-                geometry.push_back(second_node->second);
-                ++second_node;
+    bool pop(size_t& buffer_rank, osmium::memory::Buffer& buffer) {
+        unique_lock<mutex> lock{mut};
+        not_empty.wait(lock, [this]() { return !buffers.empty() || is_closed; });
+        if (buffers.empty())
+            return false;
+        buffer_rank = buffers.front().first;
+        buffer = move(buffers.front().second);
+        buffers.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+   private:
+    size_t max_size;
+    bool is_closed = false;
+    deque<pair<size_t, osmium::memory::Buffer>> buffers;
+    mutex mut;
+    condition_variable not_empty;
+    condition_variable not_full;
+};
+
+// the ways of each buffer are stored in their own chunk, so that the chunks can be merged in the file order :
+using WaysChunks = vector<pair<size_t, WaysNodes>>;
+
+// each worker fills its own shard of every region (a way is located once, then routed to each region that accepts it),
+// and hands out the chunk of ways of each buffer to the sink :
+static void _fill_shard(vector<FillingHandler>& shard,
+                        size_t thread_index,
+                        LocationIndex const& index,
+                        BufferQueue& queue,
+                        WaysChunkSink const& sink) {
+    size_t buffer_rank;
+    osmium::memory::Buffer buffer;
+    while (queue.pop(buffer_rank, buffer)) {
+        for (auto& way : buffer.select<osmium::Way>()) {
+            WayVerdict verdict = evaluate_way(way);
+            if (!verdict.is_walkable)
+                continue;
+            for (auto& node_ref : way.nodes()) {
+                node_ref.set_location(index.get_noexcept(node_ref.positive_ref()));
+            }
+            for (auto& region_shard : shard) {
+                region_shard.add_way(way, verdict.speed_factor);
             }
+        }
+        for (size_t region_index = 0; region_index < shard.size(); ++region_index) {
+            WaysNodes& ways_nodes = shard[region_index].ways_nodes;
+            if (ways_nodes.size() > 0) {
+                sink(thread_index, region_index, buffer_rank, move(ways_nodes));
+                ways_nodes.clear();
+            }
+        }
+    }
+}
 
-            // à ce stade, second_node pointe vers le premier node (après first_node) qui a un compteur >= 2
-            // (ou bien vers end() s'il n'y en avait pas, ce qui veut dire que la way était une impasse se finissant sur
-            // le dernier noeud)
+static void _parse_in_parallel(string const& osmfile,
+                               LocationIndex& index,
+                               NodeIdsCollectingHandler::NodeIdSet const& node_ids,
+                               vector<PreparedPolygon> const& polygons,
+                               size_t nb_threads,
+                               WaysChunkSink const& sink) {
+    // The nodes are processed by the reading thread (they fill the location index).
+    // The ways are processed by the worker threads, each of them filling its own shard of ways (one per region).
+    // precondition = the OSM file is sorted (all nodes come before the ways), which is the case of PBF extracts.
+    // (the shards only refer to the prepared polygons, that are shared by all the threads)
+    vector<vector<FillingHandler>> shards(nb_threads);
+    for (auto& shard : shards) {
+        for (auto const& polygon : polygons) {
+            shard.emplace_back(&polygon);
+        }
+    }
+    BufferQueue queue{2 * nb_threads};
+    vector<thread> workers;
+    for (size_t shard_index = 0; shard_index < nb_threads; ++shard_index) {
+        workers.emplace_back(_fill_shard, ref(shards[shard_index]), shard_index, cref(index), ref(queue), cref(sink));
+    }
 
-            // si second_node est à end, c'est que le dernier node de la way n'avait pas un compteur >= 2
-            // Dit autrement : la way était une impasse, se terminant sur second_node.
-            // Dans ce cas, on ajoute l'edge, et on a fini pour cette way :
-            if (second_node == nodes.end()) {
-                add_edge(edges, first_node->first, (second_node - 1)->first, std::move(geometry), walkspeed_m_per_s);
+    osmium::io::Reader reader{osmfile, osmium::osm_entity_bits::node | osmium::osm_entity_bits::way};
+    bool are_ways_reached = false;
+    bool is_file_sorted = true;
+    size_t buffer_rank = 0;
+    while (osmium::memory::Buffer buffer = reader.read()) {
+        for (auto const& node : buffer.select<osmium::Node>()) {
+            if (are_ways_reached) {
+                is_file_sorted = false;
                 break;
             }
+            if (node_ids.get(node.positive_id()))
+                index.set(node.positive_id(), node.location());
+        }
+        if (!is_file_sorted)
+            break;
 
-            // cas général : on ajoute le subedge, et on continue d'itérer sur la way :
-            geometry.push_back(second_node->second);
-            add_edge(edges, first_node->first, second_node->first, std::move(geometry), walkspeed_m_per_s);
-            first_node = second_node;
+        // once the first way is reached, the index is complete, and can be shared (read-only) by the workers :
+        auto ways = buffer.select<osmium::Way>();
+        if (!are_ways_reached && ways.begin() != ways.end()) {
+            index.sort();
+            are_ways_reached = true;
+        }
+        if (are_ways_reached)
+            queue.push(buffer_rank++, move(buffer));
+    }
+    reader.close();
+    queue.close();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (!is_file_sorted)
+        throw runtime_error("ERROR : OSM file is not sorted (some nodes appear after the ways)");
+}
+
+void stream_osm_ways(string const& osmfile,
+                     vector<BgPolygon> const& polygons,
+                     size_t nb_threads,
+                     WaysChunkSink const& sink) {
+    // the parsing is done in two passes, so that only the locations of the useful nodes are stored :
+    //  - first pass  = collecting the ids of the nodes used by interesting ways
+    //  - second pass = storing the locations of those nodes only, and handing out the located ways
+    //                  (the ways are processed in parallel)
+    // (whatever the number of regions, the file is read only once per pass)
+
+    // first pass (ways only) :
+    NodeIdsCollectingHandler collecting_handler;
+    osmium::io::Reader ways_reader{osmfile, osmium::osm_entity_bits::way};
+    osmium::apply(ways_reader, collecting_handler);
+    ways_reader.close();
+    cout << "Number of nodes used by interesting ways = " << collecting_handler.node_ids.size() << endl;
+    cout << "Memory used by the set of node ids = " << collecting_handler.node_ids.used_memory() / (1024 * 1024)
+         << " MB" << endl;
+    print_memory_usage("first pass");
+
+    // second pass (nodes + ways) :
+    auto index = _create_location_index(osmfile);
+    vector<PreparedPolygon> prepared_polygons;
+    prepared_polygons.reserve(polygons.size());
+    for (auto const& polygon : polygons) {
+        prepared_polygons.emplace_back(polygon);
+    }
+    _parse_in_parallel(osmfile, *index, collecting_handler.node_ids, prepared_polygons, max(nb_threads, size_t{1}),
+                       sink);
+    cout << "Memory used by the location index = " << index->used_memory() / (1024 * 1024) << " MB" << endl;
+    print_memory_usage("second pass");
+
+    // (the locations are no longer needed once the ways are handed out : the index is released here)
+}
 
-            // NOTE : quoi qu'il arrive, on aura au moins un edge ajouté contenant le premier node, et un edge ajouté
-            // contenant le dernier node (qui pourra ou non être le même).
+vector<FillingHandler> parse_osm_ways(string const& osmfile, vector<BgPolygon> const& polygons, size_t nb_threads) {
+    // each thread stores the chunks of ways it parsed, and counts the usage of their nodes, in its own shard :
+    nb_threads = max(nb_threads, size_t{1});
+    vector<vector<WaysChunks>> shards_chunks(nb_threads, vector<WaysChunks>(polygons.size()));
+    vector<vector<NodeUseCounter>> shards_counters(nb_threads, vector<NodeUseCounter>(polygons.size()));
+    stream_osm_ways(osmfile, polygons, nb_threads, [&shards_chunks, &shards_counters](size_t thread_index,
+                                                                                       size_t region_index,
+                                                                                       size_t buffer_rank,
+                                                                                       WaysNodes&& chunk) {
+        NodeUseCounter& node_use_counter = shards_counters[thread_index][region_index];
+        for (auto const& [node_id, _] : chunk.nodes) {
+            node_use_counter.increment(node_id);
+        }
+        shards_chunks[thread_index][region_index].emplace_back(buffer_rank, move(chunk));
+    });
+
+    // the shards are merged deterministically (the ways are merged in the file order, whatever the sharding) :
+    vector<FillingHandler> handlers;
+    handlers.reserve(polygons.size());
+    for (size_t region_index = 0; region_index < polygons.size(); ++region_index) {
+        handlers.emplace_back(nullptr);  // (the ways are already filtered : the polygon isn't needed anymore)
+        WaysChunks all_chunks;
+        for (auto& chunks : shards_chunks) {
+            move(chunks[region_index].begin(), chunks[region_index].end(), back_inserter(all_chunks));
+            chunks[region_index].clear();
+        }
+        sort(all_chunks.begin(), all_chunks.end(), [](auto const& left, auto const& right) {
+            return left.first < right.first;
+        });
+        for (auto& [_, chunk] : all_chunks) {
+            handlers[region_index].ways_nodes.append(chunk);
+            chunk = WaysNodes{};  // each chunk is released as soon as it is merged
+        }
+        for (auto& counters : shards_counters) {
+            handlers[region_index].node_use_counter.merge(counters[region_index]);
+            counters[region_index] = NodeUseCounter{};
         }
     }
+    return handlers;
+}
 
-    return edges;
+FillingHandler parse_osm_ways(string const& osmfile, BgPolygon const& polygon, size_t nb_threads) {
+    return move(parse_osm_ways(osmfile, vector<BgPolygon>{polygon}, nb_threads).front());
 }
 
-vector<Edge> osm_to_graph(string osmfile, BgPolygon polygon, float walkspeed_km_per_h) {
-    // osmium warmup :
-    auto interesting_types = osmium::osm_entity_bits::node | osmium::osm_entity_bits::way;
-    using Index = osmium::index::map::SparseMmapArray<osmium::unsigned_object_id_type, osmium::Location>;
-    Index index;
-    osmium::handler::NodeLocationsForWays<Index> location_handler{index};
-    FillingHandler handler{polygon};
-    osmium::io::Reader reader{osmfile, interesting_types};
-
-    // parse osmfile + fill-in data structures :
-    osmium::apply(reader, location_handler, handler);
-    reader.close();
+vector<Edge> osm_to_graph(string osmfile,
+                          BgPolygon polygon,
+                          float walkspeed_km_per_h,
+                          GeometryArena& geometries,
+                          size_t nb_threads) {
+    FillingHandler handler = parse_osm_ways(osmfile, polygon, nb_threads);
 
     // build graph edges :
-    auto edges = build_graph(handler.way_to_nodes, handler.node_use_counter, walkspeed_km_per_h);
+    auto edges = build_graph(handler.ways_nodes, handler.node_use_counter, walkspeed_km_per_h, geometries, nb_threads);
+    print_memory_usage("graph building");
     return edges;
 }
 
+vector<RegionEdges> osm_to_graphs(string const& osmfile,
+                                  vector<BgPolygon> const& polygons,
+                                  float walkspeed_km_per_h,
+                                  size_t nb_threads) {
+    vector<FillingHandler> handlers = parse_osm_ways(osmfile, polygons, nb_threads);
+
+    // the graphs of the regions are independent, thus built concurrently (each one by a single thread) :
+    vector<RegionEdges> regions(handlers.size());
+    parallel_for(handlers.size(), nb_threads, [&handlers, &regions, walkspeed_km_per_h](size_t, size_t region_index) {
+        FillingHandler& handler = handlers[region_index];
+        regions[region_index].edges = build_graph(handler.ways_nodes, handler.node_use_counter, walkspeed_km_per_h,
+                                                  regions[region_index].geometries, 1);
+        handler.ways_nodes = WaysNodes{};  // the ways of a region are released as soon as its graph is built
+    }, 1);
+    print_memory_usage("graph building");
+    return regions;
+}
+
 }  // namespace uwpreprocess
@@ -1,12 +1,62 @@
 #pragma once
 
+#include <functional>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "graph/graphtypes.h"
+#include "graph/osmparsing.h"
 #include "graph/polygon.h"
+#include "graph/ways_storage.h"
 
 namespace uwpreprocess {
 
-std::vector<Edge> osm_to_graph(std::string osmfile, BgPolygon polygon, float walkspeed_km_per_h);
+// parses the interesting ways (in polygon) of the OSM file, along with the locations of their nodes :
+FillingHandler parse_osm_ways(std::string const& osmfile,
+                              BgPolygon const& polygon,
+                              size_t nb_threads = std::thread::hardware_concurrency());
+
+// Lower-level parsing, used by parse_osm_ways : the located interesting ways are handed out to the sink by chunks (one
+// chunk per buffer of the OSM file and per region), from the worker thread that parsed them. The rank of a chunk is the
+// position of its buffer in the file (thus, merging the chunks by rank gives the ways in the file order).
+using WaysChunkSink =
+    std::function<void(size_t thread_index, size_t region_index, size_t buffer_rank, WaysNodes&& chunk)>;
+void stream_osm_ways(std::string const& osmfile,
+                     std::vector<BgPolygon> const& polygons,
+                     size_t nb_threads,
+                     WaysChunkSink const& sink);
+
+// same, for several regions at once (the OSM file is read only once, and each way is routed to every region whose
+// polygon accepts it) : the i-th handler is the one of the i-th polygon
+std::vector<FillingHandler> parse_osm_ways(std::string const& osmfile,
+                                           std::vector<BgPolygon> const& polygons,
+                                           size_t nb_threads = std::thread::hardware_concurrency());
+
+// splits a way into edges, at each of its nodes that is used by another way (the edges are appended) :
+void build_way_edges(WayNodes const& nodes,
+                     NodeUseCounter const& number_of_node_usage,
+                     float walkspeed_m_per_s,
+                     GeometryArena& geometries,
+                     std::vector<Edge>& edges);
+
+std::vector<Edge> osm_to_graph(std::string osmfile,
+                               BgPolygon polygon,
+                               float walkspeed_km_per_h,
+                               GeometryArena& geometries,  // filled with the geometries of the edges
+                               size_t nb_threads = std::thread::hardware_concurrency());
+
+// the edges of the OSM graph of a region, and their geometries :
+struct RegionEdges {
+    std::vector<Edge> edges;
+    GeometryArena geometries;
+};
+
+// same as osm_to_graph, for several regions at once : the OSM file is read only once, then the graphs of the regions
+// are built concurrently (the i-th graph is the one of the i-th polygon) :
+std::vector<RegionEdges> osm_to_graphs(std::string const& osmfile,
+                                       std::vector<BgPolygon> const& polygons,
+                                       float walkspeed_km_per_h,
+                                       size_t nb_threads = std::thread::hardware_concurrency());
 
 }
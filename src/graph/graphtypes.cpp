@@ -0,0 +1,73 @@
+#include <limits>
+
+#include "graph/graphtypes.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+static const string OSM_NODE_URL_PREFIX = node_url(0).substr(0, node_url(0).size() - 1);
+
+NodeId NodeNames::add_stop(StopId const& stop_id) {
+    auto [ite, is_inserted] = stop_id_to_index.insert({stop_id, stop_ids.size()});
+    if (is_inserted) {
+        stop_ids.push_back(stop_id);
+    }
+    return stop_node_id(ite->second);
+}
+
+string NodeNames::id(NodeId node) const {
+    if (is_stop_node(node)) {
+        return stop_ids.at(stop_index(node));
+    }
+    return node_url(static_cast<NodeOsmId>(node));  // for OSM nodes, node ids are their URL
+}
+
+string NodeNames::url(NodeId node) const {
+    if (is_stop_node(node)) {
+        return {};
+    }
+    return node_url(static_cast<NodeOsmId>(node));
+}
+
+NodeId NodeNames::parse(string const& node_name) {
+    if (node_name.compare(0, OSM_NODE_URL_PREFIX.size(), OSM_NODE_URL_PREFIX) == 0) {
+        return osm_node_id(stoll(node_name.substr(OSM_NODE_URL_PREFIX.size())));
+    }
+    return add_stop(node_name);
+}
+
+GeometryView GeometryArena::close_polyline() {
+    if (locations.size() - polyline_start > numeric_limits<uint32_t>::max()) {
+        throw runtime_error("ERROR : polyline is too long to be stored in the geometry arena");
+    }
+    GeometryView view{polyline_start, static_cast<uint32_t>(locations.size() - polyline_start), false};
+    polyline_start = locations.size();
+    return view;
+}
+
+GeometryView GeometryArena::add(Polyline const& polyline) {
+    locations.insert(locations.end(), polyline.begin(), polyline.end());
+    return close_polyline();
+}
+
+void GeometryArena::assign(vector<osmium::Location>&& locations_) {
+    locations = move(locations_);
+    polyline_start = locations.size();
+}
+
+bool are_edges_equal(vector<Edge> const& left,
+                     GeometryArena const& left_geometries,
+                     vector<Edge> const& right,
+                     GeometryArena const& right_geometries) {
+    if (left != right)
+        return false;
+    for (size_t edge_index = 0; edge_index < left.size(); ++edge_index) {
+        if (!(left_geometries.polyline(left[edge_index].geometry) ==
+              right_geometries.polyline(right[edge_index].geometry)))
+            return false;
+    }
+    return true;
+}
+
+}  // namespace uwpreprocess
@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "graph/types.h"
 
@@ -9,18 +15,34 @@ namespace uwpreprocess {
 inline std::string node_url(NodeOsmId id) {
     return std::string("https://www.openstreetmap.org/node/") + std::to_string(id);
 }
-using NodeId = std::string;
+
+// In the graph, a node is identified by a compact integer NodeId (see types.h) :
+//  - for OSM nodes, the NodeId is the OSM id (precondition = OSM ids are positive)
+//  - for stops, the NodeId is the index of the stop in the NodeNames table, tagged with STOP_NODE_TAG
+constexpr const NodeId STOP_NODE_TAG = NodeId{1} << 63;
+inline NodeId osm_node_id(NodeOsmId osm_id) { return static_cast<NodeId>(osm_id); }
+inline NodeId stop_node_id(size_t stop_index) { return STOP_NODE_TAG | stop_index; }
+inline bool is_stop_node(NodeId id) { return (id & STOP_NODE_TAG) != 0; }
+inline size_t stop_index(NodeId id) { return static_cast<size_t>(id & ~STOP_NODE_TAG); }
+
+// NodeNames is the (interned) string table of the nodes : the strings are only expanded at serialization time.
+//  - the name (=id) of an OSM node is its URL
+//  - the name of a stop is its stop id (a stop has no URL)
+struct NodeNames {
+    NodeId add_stop(StopId const& stop_id);  // returns the NodeId of the stop (interning it if needed)
+    std::string id(NodeId node) const;
+    std::string url(NodeId node) const;
+    NodeId parse(std::string const& node_name);  // reverse of id()
+
+    std::vector<StopId> stop_ids;
+    std::unordered_map<StopId, size_t> stop_id_to_index;
+};
 
 struct Node {
     static constexpr const size_t UNRANKED = SIZE_MAX;
 
-    inline Node(NodeOsmId osm_id_, osmium::Location const& location_)
-        : url{node_url(osm_id_)},
-          id{url},  // for OSM nodes, node ids are their URL
-          location{location_} {}
-
-    inline Node(NodeId id, osmium::Location const& location_, size_t rank_ = UNRANKED)
-        : url{}, id{id}, location{location_}, rank{rank_} {}
+    inline Node(NodeId id_, osmium::Location const& location_, size_t rank_ = UNRANKED)
+        : id{id_}, location{location_}, rank{rank_} {}
 
     inline double lon() const { return location.lon(); }
     inline double lat() const { return location.lat(); }
@@ -43,7 +65,6 @@ struct Node {
         return this->id == other.id && this->rank == other.rank;
     }  // needed by set<T>
 
-    std::string url;
     NodeId id;
     osmium::Location location;
 
@@ -52,14 +73,96 @@ struct Node {
 };
 
 struct NodeHasher {
-    size_t operator()(Node const& n) const { return std::hash<std::string>{}(n.id); }
+    size_t operator()(Node const& n) const { return std::hash<NodeId>{}(n.id); }
+};
+
+// All the geometries of the graph are stored once, contiguously, in a GeometryArena.
+// An edge only holds a GeometryView on its geometry (its position in the arena, and its direction) :
+// this allows a reversed edge to share the geometry of its forward edge.
+struct GeometryView {
+    size_t offset = 0;
+    uint32_t length = 0;
+    bool is_reversed = false;
+
+    inline GeometryView reversed() const { return {offset, length, !is_reversed}; }
+};
+
+// A PolylineRange allows to iterate on the locations of a GeometryView, in the direction of the view :
+class PolylineRange {
+   public:
+    class iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = osmium::Location;
+        using difference_type = std::ptrdiff_t;
+        using pointer = osmium::Location const*;
+        using reference = osmium::Location const&;
+
+        inline iterator(PolylineRange const& range_, size_t index_) : range{&range_}, index{index_} {}
+        inline osmium::Location const& operator*() const { return (*range)[index]; }
+        inline iterator& operator++() {
+            ++index;
+            return *this;
+        }
+        inline iterator operator+(size_t offset) const { return {*range, index + offset}; }
+        inline bool operator==(iterator const& other) const { return index == other.index; }
+        inline bool operator!=(iterator const& other) const { return index != other.index; }
+
+       private:
+        PolylineRange const* range;
+        size_t index;
+    };
+
+    inline PolylineRange(osmium::Location const* first_, size_t length_, bool is_reversed_)
+        : first{first_}, length{length_}, is_reversed{is_reversed_} {}
+
+    inline size_t size() const { return length; }
+    inline osmium::Location const& operator[](size_t index) const {
+        return is_reversed ? first[length - 1 - index] : first[index];
+    }
+    inline osmium::Location const& front() const { return (*this)[0]; }
+    inline osmium::Location const& back() const { return (*this)[length - 1]; }
+    inline iterator begin() const { return {*this, 0}; }
+    inline iterator end() const { return {*this, length}; }
+
+    // comparing two ranges compares their content (not their position in the arena) :
+    inline bool operator==(PolylineRange const& other) const {
+        return size() == other.size() && std::equal(begin(), end(), other.begin());
+    }
+
+   private:
+    osmium::Location const* first;
+    size_t length;
+    bool is_reversed;
+};
+
+struct GeometryArena {
+    // a polyline is added by pushing its locations one by one, then closing it :
+    inline void push_back(osmium::Location const& location) { locations.push_back(location); }
+    GeometryView close_polyline();  // the polyline is made of the locations pushed since the last close
+    GeometryView add(Polyline const& polyline);
+    void assign(std::vector<osmium::Location>&& locations_);  // replaces the content by already closed polylines
+
+    inline PolylineRange polyline(GeometryView const& view) const {
+        return {locations.data() + view.offset, view.length, view.is_reversed};
+    }
+
+    std::vector<osmium::Location> locations;
+
+   private:
+    size_t polyline_start = 0;
 };
 
 // NOTE : a single OSM way can be splitted in several edges.
 struct Edge {
-    inline Edge(NodeOsmId node_from_, NodeOsmId node_to_, Polyline&& geometry_, float length_m_, float weight_)
-        : node_from{node_from_, geometry_.front()},
-          node_to{node_to_, geometry_.back()},
+    inline Edge(NodeOsmId node_from_,
+                NodeOsmId node_to_,
+                GeometryArena const& geometries,
+                GeometryView geometry_,
+                float length_m_,
+                float weight_)
+        : node_from{osm_node_id(node_from_), geometries.polyline(geometry_).front()},
+          node_to{osm_node_id(node_to_), geometries.polyline(geometry_).back()},
           length_m{length_m_},
           weight{weight_},
           geometry{geometry_} {}
@@ -68,25 +171,33 @@ struct Edge {
                 size_t rank_from,
                 NodeId node_to_,
                 size_t rank_to,
-                Polyline&& geometry_,
+                GeometryArena const& geometries,
+                GeometryView geometry_,
                 float length_m_,
                 float weight_)
-        : node_from{node_from_, geometry_.front(), rank_from},
-          node_to{node_to_, geometry_.back(), rank_to},
+        : node_from{node_from_, geometries.polyline(geometry_).front(), rank_from},
+          node_to{node_to_, geometries.polyline(geometry_).back(), rank_to},
           length_m{length_m_},
           weight{weight_},
           geometry{geometry_} {}
 
+    // the geometry is a view in an arena : comparing its content needs the arenas (see are_edges_equal)
     bool operator==(Edge const& other) const {
         return (node_from == other.node_from && node_to == other.node_to && length_m == other.length_m &&
-                weight == other.weight && geometry == other.geometry);
+                weight == other.weight && geometry.length == other.geometry.length);
     }
 
     Node node_from;
     Node node_to;
     float length_m;
     float weight;
-    Polyline geometry;
+    GeometryView geometry;
 };
 
+// compares two edge lists, including the content of their geometries :
+bool are_edges_equal(std::vector<Edge> const& left,
+                     GeometryArena const& left_geometries,
+                     std::vector<Edge> const& right,
+                     GeometryArena const& right_geometries);
+
 }  // namespace uwpreprocess
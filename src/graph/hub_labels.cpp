@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+#include "graph/hub_labels.h"
+#include "common/parallel.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+using Labels = vector<vector<HubLabels::Entry>>;  // indexed by node rank
+
+float HubLabels::distance(uint32_t from, uint32_t to) const {
+    // both labels are sorted by hub, thus their common hubs are found by merging them :
+    float best = numeric_limits<float>::infinity();
+    Entry const* left = label_begin(from);
+    Entry const* right = label_begin(to);
+    while (left != label_end(from) && right != label_end(to)) {
+        if (left->hub < right->hub) {
+            ++left;
+        } else if (right->hub < left->hub) {
+            ++right;
+        } else {
+            best = min(best, left->distance + right->distance);
+            ++left;
+            ++right;
+        }
+    }
+    return best;
+}
+
+static vector<uint32_t> _compute_vertex_order(WalkingGraph const& graph, ContractionHierarchy const* hierarchy) {
+    // the most important nodes come first : highest contraction level (the kept stops being above all the others),
+    // then highest degree (the node rank is only there to make the order deterministic) :
+    size_t nb_nodes = graph.out_edges.nb_nodes();
+    vector<uint32_t> order(nb_nodes);
+    iota(order.begin(), order.end(), 0);
+    auto level = [hierarchy](uint32_t node) { return hierarchy == nullptr ? 0 : hierarchy->levels.at(node); };
+    auto const& adjacency = graph.out_edges;
+    sort(order.begin(), order.end(), [&level, &adjacency](uint32_t left, uint32_t right) {
+        return make_tuple(level(left), adjacency.degree(left), right) >
+               make_tuple(level(right), adjacency.degree(right), left);
+    });
+    return order;
+}
+
+// Each thread owns a search, whose arrays are reused from one root to the next (only the touched entries are reset).
+class PrunedDijkstra {
+   public:
+    explicit PrunedDijkstra(CsrAdjacency const& adjacency_)
+        : adjacency{adjacency_},
+          distances(adjacency_.nb_nodes(), numeric_limits<float>::infinity()),
+          root_distances(adjacency_.nb_nodes(), numeric_limits<float>::infinity()) {}
+
+    // returns the (node, distance) that must receive the root as hub (the others are pruned, because the committed
+    // labels already give a distance at least as good) :
+    vector<pair<uint32_t, float>> run(uint32_t root, Labels const& labels) {
+        vector<pair<uint32_t, float>> labelled;
+        for (auto entry : labels[root]) {
+            root_distances[entry.hub] = entry.distance;
+        }
+
+        set_distance(root, 0);
+        queue.clear();
+        push(0, root);
+        while (!queue.empty()) {
+            auto [distance, node] = pop();
+            if (distance > distances[node])
+                continue;
+            if (is_pruned(node, distance, labels))
+                continue;
+            labelled.emplace_back(node, distance);
+            for (auto out_edge : adjacency.out_edges(node)) {
+                float new_distance = distance + out_edge.weight;
+                if (new_distance >= distances[out_edge.target])
+                    continue;
+                set_distance(out_edge.target, new_distance);
+                push(new_distance, out_edge.target);
+            }
+        }
+
+        for (uint32_t node : touched) {
+            distances[node] = numeric_limits<float>::infinity();
+        }
+        touched.clear();
+        for (auto entry : labels[root]) {
+            root_distances[entry.hub] = numeric_limits<float>::infinity();
+        }
+        return labelled;
+    }
+
+   private:
+    inline bool is_pruned(uint32_t node, float distance, Labels const& labels) const {
+        for (auto entry : labels[node]) {
+            if (root_distances[entry.hub] + entry.distance <= distance)
+                return true;
+        }
+        return false;
+    }
+
+    inline void set_distance(uint32_t node, float distance) {
+        if (distances[node] == numeric_limits<float>::infinity())
+            touched.push_back(node);
+        distances[node] = distance;
+    }
+
+    using QueueItem = pair<float, uint32_t>;
+    inline void push(float distance, uint32_t node) {
+        queue.emplace_back(distance, node);
+        push_heap(queue.begin(), queue.end(), greater<QueueItem>{});
+    }
+    inline QueueItem pop() {
+        pop_heap(queue.begin(), queue.end(), greater<QueueItem>{});
+        QueueItem item = queue.back();
+        queue.pop_back();
+        return item;
+    }
+
+    CsrAdjacency const& adjacency;
+    vector<float> distances;       // indexed by node rank
+    vector<float> root_distances;  // indexed by hub : the label of the current root
+    vector<uint32_t> touched;
+    vector<QueueItem> queue;
+};
+
+HubLabels compute_hub_labels(WalkingGraph const& graph, ContractionHierarchy const* hierarchy, size_t nb_threads) {
+    auto start = chrono::steady_clock::now();
+    nb_threads = max(nb_threads, size_t{1});
+    size_t nb_nodes = graph.out_edges.nb_nodes();
+
+    HubLabels hub_labels;
+    hub_labels.order = _compute_vertex_order(graph, hierarchy);
+
+    // The roots are processed by batches : the searches of a batch run in parallel, and only see the labels of the
+    // previous batches. Thus, a batch prunes less than sequential roots would (the labels are a bit larger), but the
+    // labels are still exact, and do not depend on the number of threads.
+    // The first roots are the most important ones (they prune the most), so the batches start small, and grow with the
+    // number of processed roots (which bounds the proportion of labels missed by the pruning).
+    constexpr const size_t BATCH_GROWTH_DIVISOR = 16;
+    constexpr const size_t MAX_BATCH_SIZE = 1024;
+    Labels labels(nb_nodes);
+    vector<PrunedDijkstra> searches(nb_threads, PrunedDijkstra{graph.out_edges});
+    size_t nb_processed = 0;
+    while (nb_processed < nb_nodes) {
+        size_t batch_size = clamp(nb_processed / BATCH_GROWTH_DIVISOR, size_t{1}, MAX_BATCH_SIZE);
+        batch_size = min(batch_size, nb_nodes - nb_processed);
+
+        vector<vector<pair<uint32_t, float>>> labelled_by_root(batch_size);
+        parallel_for(
+            batch_size, nb_threads,
+            [&hub_labels, &labels, &searches, &labelled_by_root, nb_processed](size_t thread_index, size_t item) {
+                uint32_t hub = static_cast<uint32_t>(nb_processed + item);
+                labelled_by_root[item] = searches[thread_index].run(hub_labels.order[hub], labels);
+            },
+            1);
+
+        // the labels are committed in the hub order, so that each label stays sorted by hub :
+        for (size_t item = 0; item < batch_size; ++item) {
+            uint32_t hub = static_cast<uint32_t>(nb_processed + item);
+            for (auto [node, distance] : labelled_by_root[item]) {
+                labels[node].push_back({hub, distance});
+            }
+        }
+        nb_processed += batch_size;
+    }
+
+    // compacting the labels :
+    size_t nb_entries = 0;
+    for (auto const& label : labels) {
+        nb_entries += label.size();
+    }
+    hub_labels.offsets.reserve(nb_nodes + 1);
+    hub_labels.entries.reserve(nb_entries);
+    size_t max_label_size = 0;
+    for (auto& label : labels) {
+        max_label_size = max(max_label_size, label.size());
+        hub_labels.entries.insert(hub_labels.entries.end(), label.begin(), label.end());
+        hub_labels.offsets.push_back(hub_labels.entries.size());
+        label = vector<HubLabels::Entry>{};
+    }
+
+    auto& statistics = hub_labels.statistics;
+    statistics.nb_entries = nb_entries;
+    statistics.max_label_size = max_label_size;
+    statistics.average_label_size = nb_nodes == 0 ? 0 : static_cast<double>(nb_entries) / nb_nodes;
+    statistics.build_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Hub labels : " << nb_entries << " entries, average label size = " << statistics.average_label_size
+         << ", max label size = " << max_label_size << ", built in " << statistics.build_seconds << " s" << endl;
+    return hub_labels;
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "graph/contraction.h"
+#include "graph/walking_graph.h"
+
+namespace uwpreprocess {
+
+// Hub labels of a walking graph (nodes are identified by their rank) :
+//  - the hubs are identified by their position in the vertex order (hub i is the node order[i])
+//  - the label of a node is a list of (hub, distance), sorted by hub : the distance between two nodes is the minimum,
+//    over their common hubs, of the sum of their distances to the hub
+// As the walking graph is bidirectional, a single label per node is enough (forward and backward labels are equal).
+struct HubLabels {
+    struct Entry {
+        uint32_t hub;
+        float distance;
+    };
+
+    struct Statistics {
+        size_t nb_entries;
+        size_t max_label_size;
+        double average_label_size;
+        double build_seconds;
+    };
+
+    inline size_t nb_nodes() const { return offsets.size() - 1; }
+    inline Entry const* label_begin(uint32_t node) const { return entries.data() + offsets[node]; }
+    inline Entry const* label_end(uint32_t node) const { return entries.data() + offsets[node + 1]; }
+
+    // returns infinity if the nodes are not connected :
+    float distance(uint32_t from, uint32_t to) const;
+
+    std::vector<uint32_t> order;        // order[i] = rank of the i-th most important node
+    std::vector<uint64_t> offsets{0};   // the label of the node of rank r is entries[offsets[r], offsets[r+1])
+    std::vector<Entry> entries;
+    Statistics statistics{0, 0, 0, 0};  // not serialized
+};
+
+// Pruned Landmark Labeling : a pruned Dijkstra is run from each node, in the vertex order.
+// The vertex order is given by the contraction hierarchy if any (most important = highest level), or else by degree.
+HubLabels compute_hub_labels(WalkingGraph const& graph,
+                             ContractionHierarchy const* hierarchy = nullptr,
+                             size_t nb_threads = std::thread::hardware_concurrency());
+
+}  // namespace uwpreprocess
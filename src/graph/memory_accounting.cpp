@@ -0,0 +1,116 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef UWPREPROCESS_MEMORY_ACCOUNTING
+#include <malloc.h>
+#endif
+
+#include <osmium/util/memory.hpp>
+
+#include "graph/memory_accounting.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+static atomic<size_t> current_bytes{0};
+static atomic<size_t> peak_bytes{0};
+static atomic<size_t> nb_allocations{0};
+
+#ifdef UWPREPROCESS_MEMORY_ACCOUNTING
+// the sizes are the usable sizes of the blocks (so that allocation and deallocation of a block count the same) :
+static void* _counted_malloc(size_t size) noexcept {
+    void* block = malloc(size == 0 ? 1 : size);
+    if (block == nullptr)
+        return nullptr;
+    size_t block_size = malloc_usable_size(block);
+    size_t current = current_bytes.fetch_add(block_size, memory_order_relaxed) + block_size;
+    size_t peak = peak_bytes.load(memory_order_relaxed);
+    while (current > peak && !peak_bytes.compare_exchange_weak(peak, current, memory_order_relaxed)) {
+    }
+    nb_allocations.fetch_add(1, memory_order_relaxed);
+    return block;
+}
+
+static void _counted_free(void* block) noexcept {
+    if (block == nullptr)
+        return;
+    current_bytes.fetch_sub(malloc_usable_size(block), memory_order_relaxed);
+    free(block);
+}
+#endif
+
+bool is_memory_accounting_enabled() {
+#ifdef UWPREPROCESS_MEMORY_ACCOUNTING
+    return true;
+#else
+    return false;
+#endif
+}
+
+MemoryStats memory_stats() {
+    return {current_bytes.load(memory_order_relaxed), peak_bytes.load(memory_order_relaxed),
+            nb_allocations.load(memory_order_relaxed)};
+}
+
+void start_memory_stage() {
+    peak_bytes.store(current_bytes.load(memory_order_relaxed), memory_order_relaxed);
+    nb_allocations.store(0, memory_order_relaxed);
+}
+
+void print_memory_usage(string const& stage_name) {
+    constexpr const size_t ONE_MEGABYTE = 1024 * 1024;
+    if (is_memory_accounting_enabled()) {
+        MemoryStats stats = memory_stats();
+        cout << "Memory used by " << stage_name << " : current = " << stats.current_bytes / ONE_MEGABYTE
+             << " MB, peak = " << stats.peak_bytes / ONE_MEGABYTE << " MB, allocations = " << stats.nb_allocations
+             << endl;
+    } else {
+        osmium::MemoryUsage memory;
+        cout << "Memory used by " << stage_name << " : current = " << memory.current()
+             << " MB, peak (since start) = " << memory.peak() << " MB" << endl;
+    }
+    start_memory_stage();
+}
+
+}  // namespace uwpreprocess
+
+#ifdef UWPREPROCESS_MEMORY_ACCOUNTING
+// replacement of the global allocation functions (the other forms default to these ones) :
+void* operator new(size_t size) {
+    void* block = uwpreprocess::_counted_malloc(size);
+    if (block == nullptr)
+        throw std::bad_alloc{};
+    return block;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept {
+    return uwpreprocess::_counted_malloc(size);
+}
+
+void* operator new[](size_t size, std::nothrow_t const&) noexcept {
+    return uwpreprocess::_counted_malloc(size);
+}
+
+void operator delete(void* block) noexcept {
+    uwpreprocess::_counted_free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    uwpreprocess::_counted_free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    uwpreprocess::_counted_free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    uwpreprocess::_counted_free(block);
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace uwpreprocess {
+
+// Per-stage memory accounting, used to check the memory profile of the graph construction.
+//
+// When built with the CMake option UWPREPROCESS_MEMORY_ACCOUNTING, the global operator new/delete are replaced by
+// counting versions, and each stage reports its own heap peak and number of allocations.
+// Otherwise, only the process-wide memory usage is available (and the peak is the peak since the process start).
+
+struct MemoryStats {
+    size_t current_bytes = 0;   // heap currently allocated
+    size_t peak_bytes = 0;      // highest heap allocated since the start of the stage
+    size_t nb_allocations = 0;  // number of allocations since the start of the stage
+};
+
+bool is_memory_accounting_enabled();
+MemoryStats memory_stats();
+
+// starts a new stage (the peak and the allocation count are reset) :
+void start_memory_stage();
+
+// prints the memory usage of the current stage, then starts a new one :
+void print_memory_usage(std::string const& stage_name);
+
+}  // namespace uwpreprocess
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <osmium/handler.hpp>
+#include <osmium/io/any_input.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/visitor.hpp>
+
+#include "graph/graph.h"
+#include "graph/memory_accounting.h"
+#include "graph/osm_changes.h"
+#include "graph/osmparsing.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+NodeUseCounter count_node_usage(WaysNodes const& ways) {
+    NodeUseCounter node_use_counter;
+    for (auto const& [node_id, _] : ways.nodes) {
+        node_use_counter.increment(node_id);
+    }
+    return node_use_counter;
+}
+
+OsmWaysGraph osm_to_ways_graph(string const& osmfile,
+                               BgPolygon const& polygon,
+                               float walkspeed_km_per_h,
+                               size_t nb_threads) {
+    OsmWaysGraph graph;
+    {
+        FillingHandler handler = parse_osm_ways(osmfile, polygon, nb_threads);
+        graph.ways = handler.ways_nodes.extract(handler.ways_nodes.ordered_by_way_id());
+    }
+    // the counters are those of the (deduplicated) kept ways, so that they can be recomputed from the ways alone :
+    graph.node_use_counter = count_node_usage(graph.ways);
+
+    float walkspeed_m_per_s = walkspeed_km_per_h / 3.6;
+    graph.edge_offsets.reserve(graph.ways.size() + 1);
+    for (size_t way_index = 0; way_index < graph.ways.size(); ++way_index) {
+        build_way_edges(graph.ways.way_nodes(way_index), graph.node_use_counter,
+                        walkspeed_m_per_s * graph.ways.speed_factors[way_index], graph.geometries, graph.edges);
+        graph.edge_offsets.push_back(graph.edges.size());
+    }
+    print_memory_usage("graph building");
+    return graph;
+}
+
+// libosmium Handler that collects the last version of the changed nodes and ways (in the order of the change files) :
+struct ChangesCollectingHandler : public osmium::handler::Handler {
+    struct ChangedWay {
+        bool is_kept;  // false if the way was deleted, or is not interesting anymore
+        float speed_factor;
+        vector<NodeOsmId> node_ids;
+    };
+
+    map<WayId, ChangedWay> ways;                           // ordered by way id
+    unordered_map<NodeOsmId, osmium::Location> locations;  // the location of a deleted node is invalid
+
+    void node(osmium::Node const& node) {
+        locations[node.id()] = node.visible() ? node.location() : osmium::Location{};
+    }
+
+    void way(osmium::Way const& way) {
+        ChangedWay& changed = ways[way.id()];
+        WayVerdict verdict = evaluate_way(way);
+        changed.is_kept = way.visible() && verdict.is_walkable;
+        changed.speed_factor = verdict.speed_factor;
+        changed.node_ids.clear();
+        if (changed.is_kept) {
+            for (auto const& node_ref : way.nodes()) {
+                changed.node_ids.push_back(node_ref.ref());
+            }
+        }
+    }
+};
+
+static bool _is_in_polygon(vector<LocatedNode> const& nodes, PreparedPolygon const& polygon) {
+    // same rule as is_way_in_polygon : a way is in polygon if any of its extremities is
+    if (polygon.is_empty())
+        return true;
+    return polygon.contains(nodes.front().second.lon(), nodes.front().second.lat()) ||
+           polygon.contains(nodes.back().second.lon(), nodes.back().second.lat());
+}
+
+vector<Node> apply_osm_changes(OsmWaysGraph& graph,
+                               vector<string> const& change_files,
+                               BgPolygon const& polygon,
+                               float walkspeed_km_per_h) {
+    ChangesCollectingHandler changes;
+    for (auto const& change_file : change_files) {
+        osmium::io::Reader reader{change_file, osmium::osm_entity_bits::node | osmium::osm_entity_bits::way};
+        osmium::apply(reader, changes);
+        reader.close();
+    }
+
+    WaysNodes const& old_ways = graph.ways;
+    auto find_old_way = [&old_ways](WayId way_id) -> size_t {
+        auto found = lower_bound(old_ways.way_ids.begin(), old_ways.way_ids.end(), way_id);
+        if (found == old_ways.way_ids.end() || *found != way_id)
+            return old_ways.size();
+        return static_cast<size_t>(found - old_ways.way_ids.begin());
+    };
+
+    // the nodes of the changed ways are located with the change files, or else with the ways of the graph :
+    unordered_map<NodeOsmId, osmium::Location> locations;
+    for (auto const& [node_id, location] : changes.locations) {
+        if (location.valid())
+            locations.insert({node_id, location});
+    }
+    unordered_set<NodeOsmId> unlocated_nodes;
+    for (auto const& [_, changed] : changes.ways) {
+        for (NodeOsmId node_id : changed.node_ids) {
+            if (locations.find(node_id) == locations.end())
+                unlocated_nodes.insert(node_id);
+        }
+    }
+
+    // first scan of the graph ways : locating the nodes, and finding the ways that use a moved node
+    vector<bool> is_way_touched(old_ways.size(), false);
+    for (size_t way_index = 0; way_index < old_ways.size(); ++way_index) {
+        for (auto const& [node_id, location] : old_ways.way_nodes(way_index)) {
+            auto changed_location = changes.locations.find(node_id);
+            if (changed_location != changes.locations.end() && changed_location->second.valid() &&
+                changed_location->second != location) {
+                is_way_touched[way_index] = true;
+            }
+            if (unlocated_nodes.find(node_id) != unlocated_nodes.end())
+                locations.insert({node_id, location});
+        }
+    }
+
+    // new version of the changed ways (or nothing if the way must be removed) :
+    PreparedPolygon prepared_polygon{polygon};
+    map<WayId, vector<LocatedNode>> new_ways;
+    size_t nb_ignored_ways = 0;
+    for (auto const& [way_id, changed] : changes.ways) {
+        if (!changed.is_kept)
+            continue;
+        vector<LocatedNode> nodes;
+        for (NodeOsmId node_id : changed.node_ids) {
+            auto location = locations.find(node_id);
+            if (location == locations.end())
+                break;
+            nodes.emplace_back(node_id, location->second);
+        }
+        if (nodes.size() != changed.node_ids.size()) {
+            ++nb_ignored_ways;
+            continue;
+        }
+        if (_is_in_polygon(nodes, prepared_polygon))
+            new_ways.emplace(way_id, move(nodes));
+    }
+
+    // updating the node use counters, and noting the nodes whose counter crossed the splitting threshold (a way is
+    // split at its nodes used by at least 2 ways) :
+    unordered_map<NodeOsmId, int> counters_before;
+    auto update_counter = [&graph, &counters_before](NodeOsmId node_id, int increment) {
+        counters_before.insert({node_id, graph.node_use_counter.count(node_id)});
+        graph.node_use_counter.increment(node_id, increment);
+    };
+    for (auto const& [way_id, _] : changes.ways) {
+        size_t old_way_index = find_old_way(way_id);
+        if (old_way_index != old_ways.size()) {
+            for (auto const& [node_id, _] : old_ways.way_nodes(old_way_index)) {
+                update_counter(node_id, -1);
+            }
+        }
+    }
+    for (auto const& [_, nodes] : new_ways) {
+        for (auto const& [node_id, _] : nodes) {
+            update_counter(node_id, +1);
+        }
+    }
+    unordered_set<NodeOsmId> split_changed_nodes;
+    for (auto const& [node_id, counter_before] : counters_before) {
+        if ((counter_before >= 2) != (graph.node_use_counter.count(node_id) >= 2))
+            split_changed_nodes.insert(node_id);
+    }
+
+    // second scan of the graph ways : finding the ways that must be split differently
+    if (!split_changed_nodes.empty()) {
+        for (size_t way_index = 0; way_index < old_ways.size(); ++way_index) {
+            WayNodes nodes = old_ways.way_nodes(way_index);
+            // (the extremities of a way are always kept, whatever their counter)
+            for (auto node = nodes.begin() + 1; node + 1 < nodes.end() && !is_way_touched[way_index]; ++node) {
+                if (split_changed_nodes.find(node->first) != split_changed_nodes.end())
+                    is_way_touched[way_index] = true;
+            }
+        }
+    }
+
+    // Rebuilding the graph : the ways are merged (by way id) with the new versions of the changed ways.
+    // The edges of the unaffected ways are kept as is, the affected ways are split again.
+    // The geometries are copied in a new arena, so that the geometries of the removed edges are dropped.
+    OsmWaysGraph updated;
+    updated.edges.reserve(graph.edges.size());
+    updated.geometries.locations.reserve(graph.geometries.locations.size());
+    float walkspeed_m_per_s = walkspeed_km_per_h / 3.6;
+    vector<Node> rebuilt_nodes;
+    size_t nb_rebuilt_ways = 0;
+    auto rebuild_way = [&updated, &rebuilt_nodes, &nb_rebuilt_ways, &graph, walkspeed_m_per_s](WayId way_id,
+                                                                                             float speed_factor) {
+        size_t first_edge = updated.edges.size();
+        size_t first_node = updated.ways.offsets.back();
+        WayNodes nodes{updated.ways.nodes.data() + first_node, updated.ways.nodes.data() + updated.ways.nodes.size()};
+        build_way_edges(nodes, graph.node_use_counter, walkspeed_m_per_s * speed_factor, updated.geometries,
+                        updated.edges);
+        updated.ways.close_way(way_id, speed_factor);
+        updated.edge_offsets.push_back(updated.edges.size());
+        for (size_t edge_index = first_edge; edge_index < updated.edges.size(); ++edge_index) {
+            rebuilt_nodes.push_back(updated.edges[edge_index].node_from);
+            rebuilt_nodes.push_back(updated.edges[edge_index].node_to);
+        }
+        ++nb_rebuilt_ways;
+    };
+    auto keep_way = [&updated, &graph](size_t old_way_index) {
+        WayNodes nodes = graph.ways.way_nodes(old_way_index);
+        updated.ways.nodes.insert(updated.ways.nodes.end(), nodes.begin(), nodes.end());
+        updated.ways.close_way(graph.ways.way_ids[old_way_index], graph.ways.speed_factors[old_way_index]);
+        for (size_t edge_index = graph.edge_offsets[old_way_index]; edge_index < graph.edge_offsets[old_way_index + 1];
+             ++edge_index) {
+            Edge const& edge = graph.edges[edge_index];
+            for (auto const& location : graph.geometries.polyline(edge.geometry)) {
+                updated.geometries.push_back(location);
+            }
+            updated.edges.emplace_back(edge.node_from.id, Node::UNRANKED, edge.node_to.id, Node::UNRANKED,
+                                       updated.geometries, updated.geometries.close_polyline(), edge.length_m,
+                                       edge.weight);
+        }
+        updated.edge_offsets.push_back(updated.edges.size());
+    };
+
+    auto new_way = new_ways.begin();
+    for (size_t old_way_index = 0; old_way_index <= old_ways.size(); ++old_way_index) {
+        WayId old_way_id = old_way_index < old_ways.size() ? old_ways.way_ids[old_way_index] : 0;
+        bool is_last = old_way_index == old_ways.size();
+
+        // the new ways that come before this old way (or all the remaining ones, after the last old way) :
+        while (new_way != new_ways.end() && (is_last || new_way->first <= old_way_id)) {
+            updated.ways.nodes.insert(updated.ways.nodes.end(), new_way->second.begin(), new_way->second.end());
+            rebuild_way(new_way->first, changes.ways.at(new_way->first).speed_factor);
+            ++new_way;
+        }
+        if (is_last)
+            break;
+
+        if (changes.ways.find(old_way_id) != changes.ways.end())
+            continue;  // the old version is replaced (or removed)
+        if (!is_way_touched[old_way_index]) {
+            keep_way(old_way_index);
+            continue;
+        }
+        // the moved nodes are relocated :
+        for (auto [node_id, location] : old_ways.way_nodes(old_way_index)) {
+            auto changed_location = changes.locations.find(node_id);
+            if (changed_location != changes.locations.end() && changed_location->second.valid())
+                location = changed_location->second;
+            updated.ways.nodes.emplace_back(node_id, location);
+        }
+        rebuild_way(old_way_id, old_ways.speed_factors[old_way_index]);
+    }
+    updated.node_use_counter = move(graph.node_use_counter);
+    graph = move(updated);
+
+    cout << "OSM changes : " << changes.ways.size() << " changed ways, " << changes.locations.size()
+         << " changed nodes, " << nb_rebuilt_ways << " ways split again, " << nb_ignored_ways
+         << " ways ignored (unknown node locations)" << endl;
+
+    sort(rebuilt_nodes.begin(), rebuilt_nodes.end(), [](Node const& left, Node const& right) {
+        return left.id < right.id;
+    });
+    rebuilt_nodes.erase(unique(rebuilt_nodes.begin(), rebuilt_nodes.end(),
+                               [](Node const& left, Node const& right) { return left.id == right.id; }),
+                        rebuilt_nodes.end());
+    return rebuilt_nodes;
+}
+
+}  // namespace uwpreprocess
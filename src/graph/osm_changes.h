@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "graph/graphtypes.h"
+#include "graph/polygon.h"
+#include "graph/ways_storage.h"
+
+namespace uwpreprocess {
+
+// The OSM stage of the walking graph, kept by way : unlike the bare edges, it can be updated with OSM change files.
+struct OsmWaysGraph {
+    WaysNodes ways;                   // the interesting ways (in polygon), ordered by way id
+    NodeUseCounter node_use_counter;  // for a given node, counts how many of those ways use it
+    std::vector<Edge> edges;          // the edges of the i-th way are edges[edge_offsets[i], edge_offsets[i+1])
+    std::vector<size_t> edge_offsets{0};
+    GeometryArena geometries;
+};
+
+// same edges as osm_to_graph, but the ways are kept :
+OsmWaysGraph osm_to_ways_graph(std::string const& osmfile,
+                               BgPolygon const& polygon,
+                               float walkspeed_km_per_h,
+                               size_t nb_threads = std::thread::hardware_concurrency());
+
+NodeUseCounter count_node_usage(WaysNodes const& ways);
+
+// Applies the OSM change files (in their order) to the graph :
+//  - the created/modified/deleted ways are updated, and so are the node use counters
+//  - only the affected ways are split again into edges : the changed ways, and the ways that use a moved node, or a
+//    node whose use counter crossed the splitting threshold
+// Returns the nodes of the edges that were built again (the only graph nodes that may have appeared or moved).
+// Limitation : a way using a node that is neither in the change files nor in the graph ways can't be located, and is
+// ignored (this is reported).
+std::vector<Node> apply_osm_changes(OsmWaysGraph& graph,
+                                    std::vector<std::string> const& change_files,
+                                    BgPolygon const& polygon,
+                                    float walkspeed_km_per_h);
+
+}  // namespace uwpreprocess
@@ -8,12 +8,15 @@ using namespace std;
 namespace uwpreprocess {
 
 void FillingHandler::way(const osmium::Way& way) noexcept {
-    if (!is_way_interesting(way))
-        return;
-    if (!is_way_in_polygon(way, polygon))
+    WayVerdict verdict = evaluate_way(way);
+    if (verdict.is_walkable)
+        add_way(way, verdict.speed_factor);
+}
+
+void FillingHandler::add_way(const osmium::Way& way, float speed_factor) noexcept {
+    if (polygon != nullptr && !is_way_in_polygon(way, *polygon))
         return;
 
-    vector<LocatedNode> nodes;
     for (auto const& node : way.nodes()) {
         auto const& loc = node.location();
         if (!loc.valid()) {
@@ -22,44 +25,44 @@ void FillingHandler::way(const osmium::Way& way) noexcept {
         }
 
         // simply fills data tructures :
-        nodes.emplace_back(node.ref(), node.location());
-        if (node_use_counter.find(node.ref()) == node_use_counter.end()) {
-            node_use_counter.emplace(node.ref(), 0);
-        }
-        ++node_use_counter[node.ref()];
+        ways_nodes.nodes.emplace_back(node.ref(), node.location());
     }
-    way_to_nodes.emplace(way.id(), move(nodes));
+    ways_nodes.close_way(way.id(), speed_factor);
 };
 
-bool is_way_interesting(const osmium::Way& way) {
-    // as a rule of thumb, if a way has the 'highway' tag, it can be used for routing :
-    // FIXME : we would probably like to filter out non-pedestrian ways.
-    if (way.tags()["highway"] == nullptr)
-        return false;
+void NodeIdsCollectingHandler::way(const osmium::Way& way) noexcept {
+    // note : node locations are unknown during the first pass, thus the ways can't be filtered by polygon yet
+    if (!is_way_interesting(way))
+        return;
 
-    // some ways aren't a road, but delimits an area. We aren't interesting in them :
-    if (way.tags()["area"] != nullptr && strcmp(way.tags()["area"], "yes") == 0)
-        return false;
+    for (auto const& node : way.nodes()) {
+        node_ids.set(node.positive_ref());
+    }
+}
 
+WayVerdict evaluate_way(const osmium::Way& way) {
     // way is too short :
     if (way.nodes().size() < 2)
-        return false;
+        return {false, 0};
 
-    return true;
+    // the pedestrian profile only keeps the walkable ways (see pedestrian_profile.h for the rules) :
+    return default_compiled_profile().evaluate(way.tags());
+}
+
+bool is_way_interesting(const osmium::Way& way) {
+    return evaluate_way(way).is_walkable;
 }
 
-bool is_way_in_polygon(const osmium::Way& way, const BgPolygon& polygon) {
+bool is_way_in_polygon(const osmium::Way& way, const PreparedPolygon& polygon) {
     // if there is no polygon, consider that all ways are ok :
-    if (uwpreprocess::is_empty(polygon)) {
+    if (polygon.is_empty()) {
         return true;
     }
 
     // otherwise, a way is considered in polygon if any of its extremities is inside the polygon :
-    auto front = way.nodes().front();
-    auto back = way.nodes().front();
-    bool is_front_in_polygon = is_inside(polygon, front.lon(), front.lat());
-    bool is_back_in_polygon = is_inside(polygon, back.lon(), back.lat());
-    return is_front_in_polygon || is_back_in_polygon;
+    auto const& front = way.nodes().front();
+    auto const& back = way.nodes().back();
+    return polygon.contains(front.lon(), front.lat()) || polygon.contains(back.lon(), back.lat());
 }
 
 }  // namespace uwpreprocess
@@ -1,26 +1,39 @@
 #pragma once
 
 #include <vector>
-#include <map>
 #include <osmium/handler.hpp>
+#include <osmium/index/id_set.hpp>
 
 #include "graph/types.h"
+#include "graph/pedestrian_profile.h"
 #include "graph/polygon.h"
+#include "graph/ways_storage.h"
 
 namespace uwpreprocess {
 
-static BgPolygon DEFAULT_POLYGON{};  // by default = no polygon
-
 // libosmium Handler that fills way+nodes structures
+// (the node use counter is filled afterwards, once the ways of all the parsing threads are gathered)
 struct FillingHandler : public osmium::handler::Handler {
-    std::map<WayId, std::vector<LocatedNode> > way_to_nodes;  // stores the nodes of a way
-    std::map<NodeOsmId, int> node_use_counter;                // for a given node, counts how many ways use it
-    BgPolygon polygon;
-    inline FillingHandler(BgPolygon polygon_ = DEFAULT_POLYGON) : polygon(polygon_) {}
+    WaysNodes ways_nodes;             // stores the nodes of the ways (in parsing order)
+    NodeUseCounter node_use_counter;  // for a given node, counts how many ways use it
+    // (not owned, must outlive the parsing ; null = no polygon, all the ways are kept) :
+    PreparedPolygon const* polygon;
+    inline explicit FillingHandler(PreparedPolygon const* polygon_) : polygon(polygon_) {}
+    void way(const osmium::Way& way) noexcept;
+    void add_way(const osmium::Way& way, float speed_factor) noexcept;  // (precondition = the way is walkable)
+};
+
+// libosmium Handler that collects the ids of the nodes used by interesting ways
+// (first pass of the parsing : it allows to only store the locations of those nodes during the second pass)
+struct NodeIdsCollectingHandler : public osmium::handler::Handler {
+    using NodeIdSet = osmium::index::IdSetDense<osmium::unsigned_object_id_type>;
+    NodeIdSet node_ids;
     void way(const osmium::Way& way) noexcept;
 };
 
+// the verdict of the (default) pedestrian profile on the way (a way with less than 2 nodes is never walkable) :
+WayVerdict evaluate_way(const osmium::Way& way);
 bool is_way_interesting(const osmium::Way& way);
-bool is_way_in_polygon(const osmium::Way& way, const BgPolygon& polygon);
+bool is_way_in_polygon(const osmium::Way& way, const PreparedPolygon& polygon);
 
 }  // namespace uwpreprocess
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "graph/pedestrian_profile.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+PedestrianProfile default_pedestrian_profile() {
+    PedestrianProfile profile;
+    // motorways, trunks (without sidewalk), raceways, and the highways under construction are not listed :
+    profile.highways = {
+        {"footway", 1.0f},      {"pedestrian", 1.0f},     {"path", 1.0f},          {"steps", 0.5f},
+        {"corridor", 1.0f},     {"platform", 1.0f},       {"living_street", 1.0f}, {"residential", 1.0f},
+        {"service", 1.0f},      {"unclassified", 1.0f},   {"track", 1.0f},         {"cycleway", 1.0f},
+        {"bridleway", 1.0f},    {"road", 1.0f},           {"tertiary", 1.0f},      {"tertiary_link", 1.0f},
+        {"secondary", 1.0f},    {"secondary_link", 1.0f}, {"primary", 1.0f},       {"primary_link", 1.0f},
+    };
+    profile.denied_access = {"no", "private", "agricultural", "forestry", "delivery"};
+    profile.granted_foot = {"yes", "designated", "permissive"};
+    profile.denied_foot = {"no", "private", "use_sidepath"};
+    profile.sidewalks = {"yes", "both", "left", "right"};
+    profile.speed_factors = {
+        {"surface", "sand", 0.7f},
+        {"surface", "mud", 0.7f},
+    };
+    return profile;
+}
+
+// FNV-1a : the hash of "key=value" is computed by continuing the hash of "key" (no string is built) :
+static constexpr const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static constexpr const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+static inline uint64_t _hash_continue(uint64_t hash, string_view text) {
+    for (char c : text) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static inline uint64_t _hash(string_view text) {
+    return _hash_continue(FNV_OFFSET_BASIS, text);
+}
+
+// (splitmix64 finalizer)
+static inline uint64_t _mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+CompiledProfile::CompiledProfile(PedestrianProfile const& profile) {
+    add("highway", HIGHWAY_KEY);
+    for (auto const& [value, speed_factor] : profile.highways) {
+        add("highway=" + value, WALKABLE_HIGHWAY, speed_factor);
+    }
+    add("access", 0);
+    for (auto const& value : profile.denied_access) {
+        add("access=" + value, DENIED_ACCESS);
+    }
+    add("foot", 0);
+    for (auto const& value : profile.granted_foot) {
+        add("foot=" + value, GRANTED_FOOT);
+    }
+    for (auto const& value : profile.denied_foot) {
+        add("foot=" + value, DENIED_FOOT);
+    }
+    add("sidewalk", 0);
+    for (auto const& value : profile.sidewalks) {
+        add("sidewalk=" + value, SIDEWALK);
+    }
+    add("area", 0);
+    add("area=yes", AREA);
+    for (auto const& [key, value, speed_factor] : profile.speed_factors) {
+        add(key, 0);
+        add(key + "=" + value, 0, speed_factor);
+    }
+    build_table();
+}
+
+void CompiledProfile::add(string const& text, uint8_t flags, float speed_factor) {
+    // a text declared several times gets the union of the flags, and the product of the speed factors :
+    auto found = find_if(entries.begin(), entries.end(), [&text](Entry const& entry) { return entry.text == text; });
+    if (found == entries.end()) {
+        entries.push_back({text, flags, speed_factor});
+        return;
+    }
+    found->flags |= flags;
+    found->speed_factor *= speed_factor;
+}
+
+size_t CompiledProfile::slot(uint64_t hash) const {
+    uint32_t seed = seeds[(hash >> 32) % seeds.size()];
+    return _mix(hash ^ (seed * 0x9e3779b97f4a7c15ULL)) & (table.size() - 1);
+}
+
+void CompiledProfile::build_table() {
+    // hash and displace : the entries are dispatched in buckets, then, from the largest bucket to the smallest, a seed
+    // is searched for each bucket, such that its entries land in free (and distinct) slots of the table
+    size_t table_size = 1;
+    while (table_size < 2 * entries.size()) {
+        table_size *= 2;
+    }
+    table.assign(table_size, Entry{});
+    seeds.assign(max(entries.size() / 2, size_t{1}), 0);
+
+    vector<vector<size_t>> buckets(seeds.size());
+    for (size_t entry_index = 0; entry_index < entries.size(); ++entry_index) {
+        buckets[(_hash(entries[entry_index].text) >> 32) % seeds.size()].push_back(entry_index);
+    }
+    vector<size_t> bucket_order(buckets.size());
+    for (size_t bucket_index = 0; bucket_index < buckets.size(); ++bucket_index) {
+        bucket_order[bucket_index] = bucket_index;
+    }
+    stable_sort(bucket_order.begin(), bucket_order.end(),
+                [&buckets](size_t left, size_t right) { return buckets[left].size() > buckets[right].size(); });
+
+    constexpr const uint32_t MAX_SEED = 1 << 20;
+    vector<char> is_slot_used(table_size, false);
+    for (size_t bucket_index : bucket_order) {
+        auto const& bucket = buckets[bucket_index];
+        if (bucket.empty())
+            break;
+        uint32_t& seed = seeds[bucket_index];
+        vector<size_t> bucket_slots;
+        for (seed = 0; seed < MAX_SEED; ++seed) {
+            bucket_slots.clear();
+            for (size_t entry_index : bucket) {
+                size_t entry_slot = slot(_hash(entries[entry_index].text));
+                if (is_slot_used[entry_slot] ||
+                    find(bucket_slots.begin(), bucket_slots.end(), entry_slot) != bucket_slots.end())
+                    break;
+                bucket_slots.push_back(entry_slot);
+            }
+            if (bucket_slots.size() == bucket.size())
+                break;
+        }
+        if (seed == MAX_SEED)
+            throw runtime_error("ERROR : unable to build the perfect hash table of the pedestrian profile");
+        for (size_t rank = 0; rank < bucket.size(); ++rank) {
+            is_slot_used[bucket_slots[rank]] = true;
+            table[bucket_slots[rank]] = move(entries[bucket[rank]]);
+        }
+    }
+    entries = {};
+}
+
+CompiledProfile::Entry const* CompiledProfile::find_key(uint64_t hash, string_view key) const {
+    Entry const& entry = table[slot(hash)];
+    return entry.text == key ? &entry : nullptr;
+}
+
+CompiledProfile::Entry const* CompiledProfile::find_tag(uint64_t hash, string_view key, string_view value) const {
+    Entry const& entry = table[slot(hash)];
+    string_view text = entry.text;
+    if (text.size() != key.size() + 1 + value.size())
+        return nullptr;
+    return text.compare(0, key.size(), key) == 0 && text[key.size()] == '=' &&
+                   text.compare(key.size() + 1, value.size(), value) == 0
+               ? &entry
+               : nullptr;
+}
+
+WayVerdict CompiledProfile::evaluate(osmium::TagList const& tags) const {
+    uint8_t flags = 0;
+    float speed_factor = 1;
+    for (auto const& tag : tags) {
+        string_view key = tag.key();
+        uint64_t hash = _hash(key);
+        Entry const* key_entry = find_key(hash, key);
+        if (key_entry == nullptr)
+            continue;
+        flags |= key_entry->flags;
+
+        string_view value = tag.value();
+        hash = _hash_continue(_hash_continue(hash, "="), value);
+        Entry const* tag_entry = find_tag(hash, key, value);
+        if (tag_entry == nullptr)
+            continue;
+        flags |= tag_entry->flags;
+        speed_factor *= tag_entry->speed_factor;
+    }
+
+    constexpr const WayVerdict NOT_WALKABLE{false, 0};
+    if (!(flags & HIGHWAY_KEY) || (flags & AREA) || (flags & DENIED_FOOT))
+        return NOT_WALKABLE;
+    if ((flags & DENIED_ACCESS) && !(flags & GRANTED_FOOT))
+        return NOT_WALKABLE;
+    if (!(flags & (WALKABLE_HIGHWAY | GRANTED_FOOT | SIDEWALK)))
+        return NOT_WALKABLE;
+    return {true, speed_factor};
+}
+
+CompiledProfile const& default_compiled_profile() {
+    static CompiledProfile const profile{default_pedestrian_profile()};
+    return profile;
+}
+
+}  // namespace uwpreprocess
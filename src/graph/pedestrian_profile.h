@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <osmium/osm/tag.hpp>
+
+namespace uwpreprocess {
+
+// A pedestrian profile declares which OSM ways are walkable, and how fast :
+//  - only the ways with a 'highway' tag are considered, and areas (area=yes) are never walkable
+//  - a way is walkable if its highway value is listed, or if foot is explicitly granted, or if it has a sidewalk
+//    (e.g. a trunk road with sidewalks)
+//  - a walkable way is dropped if its foot tag forbids walking, or if its access tag does (unless foot is granted)
+//  - the walkspeed on a way is multiplied by the speed factor of its highway value, and by the speed factors of its
+//    other tags (e.g. surface=sand)
+struct PedestrianProfile {
+    struct TagFactor {
+        std::string key;
+        std::string value;
+        float speed_factor;
+    };
+
+    std::vector<std::pair<std::string, float>> highways;  // walkable highway values, and their speed factors
+    std::vector<std::string> denied_access;               // access values that forbid walking
+    std::vector<std::string> granted_foot;                // foot values that allow walking (overrides access)
+    std::vector<std::string> denied_foot;                 // foot values that forbid walking
+    std::vector<std::string> sidewalks;                   // sidewalk values that make a road walkable
+    std::vector<TagFactor> speed_factors;                 // speed factors of the other tags
+};
+
+PedestrianProfile default_pedestrian_profile();
+
+struct WayVerdict {
+    bool is_walkable;
+    float speed_factor;  // (only meaningful for a walkable way)
+};
+
+// A profile compiled into a perfect hash table (hash and displace) of its "key" and "key=value" strings :
+// the tags of a way are evaluated in a single pass, each lookup being a single probe followed by a single comparison.
+// The irrelevant tags (name, ref, ...) are discarded after a lookup of their key only.
+class CompiledProfile {
+   public:
+    explicit CompiledProfile(PedestrianProfile const& profile);
+
+    WayVerdict evaluate(osmium::TagList const& tags) const;
+
+   private:
+    enum Flag : uint8_t {
+        HIGHWAY_KEY = 1 << 0,
+        WALKABLE_HIGHWAY = 1 << 1,
+        DENIED_ACCESS = 1 << 2,
+        GRANTED_FOOT = 1 << 3,
+        DENIED_FOOT = 1 << 4,
+        SIDEWALK = 1 << 5,
+        AREA = 1 << 6,
+    };
+
+    struct Entry {
+        std::string text;  // "key" or "key=value" (an empty text marks an empty slot)
+        uint8_t flags = 0;
+        float speed_factor = 1;
+    };
+
+    void add(std::string const& text, uint8_t flags, float speed_factor = 1);
+    void build_table();
+    size_t slot(uint64_t hash) const;
+    Entry const* find_key(uint64_t hash, std::string_view key) const;
+    Entry const* find_tag(uint64_t hash, std::string_view key, std::string_view value) const;
+
+    std::vector<Entry> entries;   // the entries, before the table is built
+    std::vector<Entry> table;     // size is a power of 2
+    std::vector<uint32_t> seeds;  // displacement seed of each bucket
+};
+
+// the default profile, compiled once (at its first use) :
+CompiledProfile const& default_compiled_profile();
+
+}  // namespace uwpreprocess
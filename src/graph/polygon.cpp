@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
+#include <queue>
 
 #include "graph/polygon.h"
 
@@ -6,8 +10,9 @@ using namespace std;
 
 namespace uwpreprocess {
 
-BgPolygon create_polygon(vector<pair<double, double>> const& points) {
-    // precondition = points must be defined counter-clockwise
+BgPolygon create_polygon(vector<pair<double, double>> const& points,
+                         vector<vector<pair<double, double>>> const& holes) {
+    // precondition = points must be defined counter-clockwise (and holes must be defined clockwise)
     // precondition = polygon must be closed (= last point and first point are identical)
     // cf. https://www.boost.org/doc/libs/1_74_0/libs/geometry/doc/html/geometry/reference/models/model_polygon.html
     BgPolygon polygon;
@@ -16,6 +21,13 @@ BgPolygon create_polygon(vector<pair<double, double>> const& points) {
         double lat = point.second;
         boost::geometry::append(polygon.outer(), BgPoint(lon, lat));
     }
+
+    polygon.inners().resize(holes.size());
+    for (size_t hole_index = 0; hole_index < holes.size(); ++hole_index) {
+        for (auto& [lon, lat] : holes[hole_index]) {
+            boost::geometry::append(polygon.inners()[hole_index], BgPoint(lon, lat));
+        }
+    }
     return polygon;
 }
 
@@ -28,4 +40,169 @@ bool is_empty(BgPolygon const& polygon) {
     return polygon.outer().empty();
 }
 
+template <typename Callback>
+static void _sample_arc(BgPoint const& from, BgPoint const& to, size_t nb_steps, Callback callback) {
+    // the segments of a spherical polygon are great-circle arcs (and not straight lines in lon/lat)
+    // this function samples an arc with nb_steps+1 points (spherical linear interpolation)
+    auto to_radians = [](double degrees) { return degrees * M_PI / 180; };
+    auto to_vector = [&to_radians](BgPoint const& p) {
+        double lon = to_radians(boost::geometry::get<0>(p));
+        double lat = to_radians(boost::geometry::get<1>(p));
+        return array<double, 3>{cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+    };
+    auto a = to_vector(from);
+    auto b = to_vector(to);
+    array<double, 3> cross{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    double omega = atan2(sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]),
+                         a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+
+    for (size_t step = 0; step <= nb_steps; ++step) {
+        double t = static_cast<double>(step) / nb_steps;
+        if (omega < 1e-12) {
+            callback(boost::geometry::get<0>(from), boost::geometry::get<1>(from));
+            continue;
+        }
+        double weight_a = sin((1 - t) * omega) / sin(omega);
+        double weight_b = sin(t * omega) / sin(omega);
+        double x = weight_a * a[0] + weight_b * b[0];
+        double y = weight_a * a[1] + weight_b * b[1];
+        double z = weight_a * a[2] + weight_b * b[2];
+        callback(atan2(y, x) * 180 / M_PI, atan2(z, sqrt(x * x + y * y)) * 180 / M_PI);
+    }
+}
+
+constexpr const double BBOX_SAMPLING_DEGREES = 0.01;  // ~1km
+
+template <typename Callback>
+static void _for_each_segment(BgPolygon const& polygon, Callback callback) {
+    auto for_ring = [&callback](BgPolygon::ring_type const& ring) {
+        for (size_t index = 0; index + 1 < ring.size(); ++index) {
+            callback(ring[index], ring[index + 1]);
+        }
+    };
+    for_ring(polygon.outer());
+    for (auto const& inner : polygon.inners()) {
+        for_ring(inner);
+    }
+}
+
+PreparedPolygon::PreparedPolygon(BgPolygon const& polygon_, size_t grid_size_)
+    : polygon{polygon_}, grid_size{grid_size_} {
+    if (is_empty())
+        return;
+
+    // bounding-box (the arcs are sampled, as they may bulge out of the box of their extremities) :
+    min_lon = min_lat = numeric_limits<double>::max();
+    max_lon = max_lat = numeric_limits<double>::lowest();
+    _for_each_segment(polygon, [this](BgPoint const& from, BgPoint const& to) {
+        double extent = max(abs(boost::geometry::get<0>(to) - boost::geometry::get<0>(from)),
+                            abs(boost::geometry::get<1>(to) - boost::geometry::get<1>(from)));
+        size_t nb_steps = 1 + static_cast<size_t>(extent / BBOX_SAMPLING_DEGREES);
+        _sample_arc(from, to, nb_steps, [this](double lon, double lat) {
+            min_lon = min(min_lon, lon);
+            min_lat = min(min_lat, lat);
+            max_lon = max(max_lon, lon);
+            max_lat = max(max_lat, lat);
+        });
+    });
+    min_lon -= BBOX_SAMPLING_DEGREES;
+    min_lat -= BBOX_SAMPLING_DEGREES;
+    max_lon += BBOX_SAMPLING_DEGREES;
+    max_lat += BBOX_SAMPLING_DEGREES;
+    cell_width = (max_lon - min_lon) / grid_size;
+    cell_height = (max_lat - min_lat) / grid_size;
+
+    // rasterization :
+    cells.assign(grid_size * grid_size, Cell::OUTSIDE);
+    mark_boundary_cells(polygon.outer());
+    for (auto const& inner : polygon.inners()) {
+        mark_boundary_cells(inner);
+    }
+    classify_other_cells();
+}
+
+void PreparedPolygon::mark_boundary_cells(BgPolygon::ring_type const& ring) {
+    // Each arc of the ring is sampled (4 samples per cell), and the 3x3 cells around each sample are marked.
+    // Thus, the marking is conservative : a cell crossed by the ring is always marked as BOUNDARY.
+    auto mark_around = [this](double lon, double lat) {
+        long col = static_cast<long>(floor((lon - min_lon) / cell_width));
+        long row = static_cast<long>(floor((lat - min_lat) / cell_height));
+        for (long r = max(row - 1, 0L); r <= min(row + 1, static_cast<long>(grid_size) - 1); ++r) {
+            for (long c = max(col - 1, 0L); c <= min(col + 1, static_cast<long>(grid_size) - 1); ++c) {
+                cells[cell_index(c, r)] = Cell::BOUNDARY;
+            }
+        }
+    };
+
+    for (size_t index = 0; index + 1 < ring.size(); ++index) {
+        auto const& from = ring[index];
+        auto const& to = ring[index + 1];
+        double extent_in_cells = max(abs(boost::geometry::get<0>(to) - boost::geometry::get<0>(from)) / cell_width,
+                                     abs(boost::geometry::get<1>(to) - boost::geometry::get<1>(from)) / cell_height);
+        size_t nb_steps = 1 + static_cast<size_t>(4 * extent_in_cells);
+        _sample_arc(from, to, nb_steps, mark_around);
+    }
+}
+
+void PreparedPolygon::classify_other_cells() {
+    // The non-BOUNDARY cells form connected regions, that are not crossed by any ring of the polygon.
+    // Thus, all the cells of a region are either INSIDE or OUTSIDE : a single exact test is needed by region.
+    vector<bool> is_classified(cells.size(), false);
+    for (size_t start = 0; start < cells.size(); ++start) {
+        if (is_classified[start] || cells[start] == Cell::BOUNDARY)
+            continue;
+
+        size_t start_col = start % grid_size;
+        size_t start_row = start / grid_size;
+        double center_lon = min_lon + (start_col + 0.5) * cell_width;
+        double center_lat = min_lat + (start_row + 0.5) * cell_height;
+        Cell region_type = is_inside(polygon, center_lon, center_lat) ? Cell::INSIDE : Cell::OUTSIDE;
+
+        // flood-fill of the region :
+        queue<size_t> to_visit;
+        to_visit.push(start);
+        is_classified[start] = true;
+        while (!to_visit.empty()) {
+            size_t current = to_visit.front();
+            to_visit.pop();
+            cells[current] = region_type;
+
+            size_t col = current % grid_size;
+            size_t row = current / grid_size;
+            auto visit = [this, &is_classified, &to_visit](size_t neighbour) {
+                if (!is_classified[neighbour] && cells[neighbour] != Cell::BOUNDARY) {
+                    is_classified[neighbour] = true;
+                    to_visit.push(neighbour);
+                }
+            };
+            if (col > 0)
+                visit(cell_index(col - 1, row));
+            if (col + 1 < grid_size)
+                visit(cell_index(col + 1, row));
+            if (row > 0)
+                visit(cell_index(col, row - 1));
+            if (row + 1 < grid_size)
+                visit(cell_index(col, row + 1));
+        }
+    }
+}
+
+bool PreparedPolygon::contains(double lon, double lat) const {
+    if (cells.empty())
+        return false;
+    if (lon < min_lon || lon >= max_lon || lat < min_lat || lat >= max_lat)
+        return false;
+
+    size_t col = min(static_cast<size_t>((lon - min_lon) / cell_width), grid_size - 1);
+    size_t row = min(static_cast<size_t>((lat - min_lat) / cell_height), grid_size - 1);
+    switch (cells[cell_index(col, row)]) {
+        case Cell::INSIDE:
+            return true;
+        case Cell::OUTSIDE:
+            return false;
+        default:
+            return is_inside(polygon, lon, lat);
+    }
+}
+
 }  // namespace uwpreprocess
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include <boost/geometry.hpp>
@@ -10,8 +11,42 @@ using BgDegree = boost::geometry::cs::spherical_equatorial<boost::geometry::degr
 using BgPoint = boost::geometry::model::point<double, 2, BgDegree>;
 using BgPolygon = boost::geometry::model::polygon<BgPoint, false /* CounterClockwise */>;
 
-BgPolygon create_polygon(std::vector<std::pair<double, double>> const& points);
+BgPolygon create_polygon(std::vector<std::pair<double, double>> const& points,
+                         std::vector<std::vector<std::pair<double, double>>> const& holes = {});
 bool is_inside(BgPolygon const& polygon, double lon, double lat);
 bool is_empty(BgPolygon const& polygon);
 
+// A PreparedPolygon is built once from a BgPolygon (possibly with holes), and allows fast point-in-polygon tests :
+//  - points outside the bounding-box of the polygon are rejected right away
+//  - the bounding-box is rasterized in a grid of cells, each cell being either :
+//      - INSIDE or OUTSIDE the polygon (no ring of the polygon crosses the cell)
+//      - BOUNDARY (a ring crosses the cell, or may cross it)
+//  - the exact (and costly) test is only done for the points in BOUNDARY cells
+// The result is the same as is_inside.
+class PreparedPolygon {
+   public:
+    explicit PreparedPolygon(BgPolygon const& polygon_, size_t grid_size_ = 512);
+
+    inline bool is_empty() const { return uwpreprocess::is_empty(polygon); }
+    bool contains(double lon, double lat) const;
+
+    BgPolygon polygon;
+
+   private:
+    enum class Cell : uint8_t { OUTSIDE, INSIDE, BOUNDARY };
+
+    void mark_boundary_cells(BgPolygon::ring_type const& ring);
+    void classify_other_cells();
+    inline size_t cell_index(size_t col, size_t row) const { return row * grid_size + col; }
+
+    size_t grid_size;
+    double min_lon = 0;
+    double min_lat = 0;
+    double max_lon = 0;
+    double max_lat = 0;
+    double cell_width = 0;
+    double cell_height = 0;
+    std::vector<Cell> cells;
+};
+
 }  // namespace uwpreprocess
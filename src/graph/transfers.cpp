@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <queue>
+
+#include "graph/transfers.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+// Each thread owns a search, whose distances are reused from one source to the next : only the touched nodes are
+// reset, so that a bounded search costs what it explores, and not the size of the graph.
+class BoundedDijkstra {
+   public:
+    BoundedDijkstra(CsrAdjacency const& adjacency_, size_t nb_stops_)
+        : adjacency{adjacency_},
+          nb_stops{nb_stops_},
+          distances(adjacency_.nb_nodes(), numeric_limits<float>::infinity()) {}
+
+    vector<Transfer> run(uint32_t source, float max_walking_seconds) {
+        using QueueItem = pair<float, uint32_t>;
+        priority_queue<QueueItem, vector<QueueItem>, greater<QueueItem>> queue;
+        vector<Transfer> transfers;
+
+        distances[source] = 0;
+        touched.push_back(source);
+        queue.emplace(0, source);
+        while (!queue.empty()) {
+            auto [distance, node] = queue.top();
+            queue.pop();
+            if (distance > distances[node])
+                continue;  // outdated item (the node was already settled with a better distance)
+
+            if (node < nb_stops && node != source) {
+                transfers.push_back({source, node, distance});
+            }
+
+            for (auto out_edge : adjacency.out_edges(node)) {
+                float new_distance = distance + out_edge.weight;
+                if (new_distance > max_walking_seconds || new_distance >= distances[out_edge.target])
+                    continue;
+                if (distances[out_edge.target] == numeric_limits<float>::infinity())
+                    touched.push_back(out_edge.target);
+                distances[out_edge.target] = new_distance;
+                queue.emplace(new_distance, out_edge.target);
+            }
+        }
+
+        for (uint32_t node : touched) {
+            distances[node] = numeric_limits<float>::infinity();
+        }
+        touched.clear();
+
+        sort(transfers.begin(), transfers.end(),
+             [](Transfer const& left, Transfer const& right) { return left.to_stop < right.to_stop; });
+        return transfers;
+    }
+
+   private:
+    CsrAdjacency const& adjacency;
+    size_t nb_stops;
+    vector<float> distances;
+    vector<uint32_t> touched;
+};
+
+vector<Transfer> compute_transfers(WalkingGraph const& graph, float max_walking_seconds, size_t nb_threads) {
+    size_t nb_stops = graph.stops_with_closest_node.size();
+
+    // The searches are dynamically scheduled : each thread grabs the next batch of sources from a shared counter.
+    // (the cost of a search varies a lot from a stop to another, so a static split would be unbalanced)
+    constexpr const size_t BATCH_SIZE = 16;
+    atomic<size_t> next_source{0};
+    vector<vector<Transfer>> transfers_by_source(nb_stops);  // each source is written by a single thread
+    auto search_sources = [&graph, &next_source, &transfers_by_source, nb_stops, max_walking_seconds]() {
+        BoundedDijkstra dijkstra{graph.out_edges, nb_stops};
+        size_t first;
+        while ((first = next_source.fetch_add(BATCH_SIZE)) < nb_stops) {
+            for (size_t source = first; source < min(first + BATCH_SIZE, nb_stops); ++source) {
+                transfers_by_source[source] = dijkstra.run(static_cast<uint32_t>(source), max_walking_seconds);
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t thread_index = 0; thread_index < max(nb_threads, size_t{1}); ++thread_index) {
+        workers.emplace_back(search_sources);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // the transfers are merged in the order of the sources (thus, the result is deterministic) :
+    vector<Transfer> transfers;
+    for (auto& source_transfers : transfers_by_source) {
+        transfers.insert(transfers.end(), source_transfers.begin(), source_transfers.end());
+        source_transfers = vector<Transfer>{};
+    }
+    cout << "Number of transfers (walking time <= " << max_walking_seconds << " s) = " << transfers.size() << endl;
+    return transfers;
+}
+
+}  // namespace uwpreprocess
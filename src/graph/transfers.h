@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "graph/walking_graph.h"
+
+namespace uwpreprocess {
+
+// A walking transfer between two stops (the stops are identified by their rank in the walking graph, which is also
+// their index in stops_with_closest_node, as the stops are ranked first) :
+struct Transfer {
+    uint32_t from_stop;
+    uint32_t to_stop;
+    float walking_seconds;
+
+    inline bool operator==(Transfer const& other) const {
+        return from_stop == other.from_stop && to_stop == other.to_stop && walking_seconds == other.walking_seconds;
+    }
+};
+
+// Runs a Dijkstra from each stop, bounded by max_walking_seconds, and returns the reachable stops.
+// The transfers are sorted by (from_stop, to_stop), whatever the number of threads.
+std::vector<Transfer> compute_transfers(WalkingGraph const& graph,
+                                        float max_walking_seconds,
+                                        size_t nb_threads = std::thread::hardware_concurrency());
+
+}  // namespace uwpreprocess
@@ -14,6 +14,7 @@ using WayId = osmium::object_id_type;
 using LocatedNode = std::pair<NodeOsmId, osmium::Location>;
 using Polyline = std::vector<osmium::Location>;
 using StopId = std::string;
+using NodeId = uint64_t;  // compact id of a node of the walking graph (see graphtypes.h)
 
 struct Stop {
     inline Stop(double lon_, double lat_, StopId id_, std::string name_) : lon(lon_), lat(lat_), id{id_}, name{name_} {}
@@ -27,15 +28,11 @@ struct Stop {
 };
 
 struct StopWithClosestNode : public Stop {
-    inline StopWithClosestNode(Stop const& stop_,
-                               std::string const& closest_node_id_,
-                               std::string const& closest_node_url_)
-        : Stop{stop_}, closest_node_id{closest_node_id_}, closest_node_url{closest_node_url_} {}
+    inline StopWithClosestNode(Stop const& stop_, NodeId closest_node_) : Stop{stop_}, closest_node{closest_node_} {}
 
-    std::string closest_node_id;
-    std::string closest_node_url;
+    NodeId closest_node;
 
-    bool operator==(StopWithClosestNode const& x) const { return static_cast<Stop const&>(*this) == static_cast<Stop const&>(x) && closest_node_id == x.closest_node_id && closest_node_url == x.closest_node_url; }
+    bool operator==(StopWithClosestNode const& x) const { return static_cast<Stop const&>(*this) == static_cast<Stop const&>(x) && closest_node == x.closest_node; }
 };
 
 }  // namespace uwpreprocess
@@ -1,96 +1,189 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <unordered_set>
 
 #include "graph/walking_graph.h"
 #include "graph/extending_with_stops.h"
 #include "graph/graph.h"
+#include "graph/memory_accounting.h"
+#include "common/parallel.h"
 
 using namespace std;
 
 namespace uwpreprocess {
 
-size_t _rank_nodes(vector<uwpreprocess::Edge>& edges_with_stops, vector<uwpreprocess::Stop> const& stops) {
+size_t _rank_nodes(vector<uwpreprocess::Edge>& edges_with_stops,
+                   vector<uwpreprocess::Stop> const& stops,
+                   NodeNames& node_names,
+                   size_t nb_threads) {
     // return the number of nodes (= 1 + the highest rank of the nodes)
     unordered_map<uwpreprocess::NodeId, size_t> node_to_rank;
 
     // some algorithms (ULTRA) require that stops are the first nodes of the graph -> we rank stops first :
     size_t current_rank = 0;
-    for_each(stops.cbegin(), stops.cend(), [&node_to_rank, &current_rank](uwpreprocess::Stop const& stop) {
-        node_to_rank.insert({stop.id, current_rank++});
-    });
+    for_each(stops.cbegin(), stops.cend(),
+             [&node_to_rank, &current_rank, &node_names](uwpreprocess::Stop const& stop) {
+                 node_to_rank.insert({node_names.add_stop(stop.id), current_rank++});
+             });
+
+    // then we can rank the other nodes in the graph, in the order of their first use by an edge.
+    // The edges are processed by contiguous ranges (one per task) :
+    //  - each range lists (concurrently) its unranked nodes, in the order of their first use in the range
+    //  - the ranges are stitched in order : a node is ranked when it is met for the first time
+    //  - the ranks are then set (concurrently) on the edges of each range
+    // This gives exactly the ranks of a serial scan of the edges, whatever the number of threads.
+    constexpr const size_t RANGES_PER_THREAD = 4;
+    size_t nb_ranges = edges_with_stops.empty() ? 0 : RANGES_PER_THREAD * max(nb_threads, size_t{1});
+    size_t range_size = (edges_with_stops.size() + nb_ranges - 1) / max(nb_ranges, size_t{1});
+    auto range_edges = [&edges_with_stops, range_size](size_t range_index) {
+        size_t first = min(range_index * range_size, edges_with_stops.size());
+        return make_pair(first, min(first + range_size, edges_with_stops.size()));
+    };
 
-    auto rank_that_node = [&node_to_rank, &current_rank](auto& node) {
-        if (node_to_rank.find(node.id) == node_to_rank.end()) {
-            node_to_rank.insert({node.id, current_rank++});
+    vector<vector<uwpreprocess::NodeId>> ranges_new_nodes(nb_ranges);
+    parallel_for(nb_ranges, nb_threads, [&](size_t, size_t range_index) {
+        unordered_set<uwpreprocess::NodeId> seen;
+        auto list_node = [&](uwpreprocess::Node const& node) {
+            if (node_to_rank.find(node.id) == node_to_rank.end() && seen.insert(node.id).second) {
+                ranges_new_nodes[range_index].push_back(node.id);
+            }
+        };
+        auto [first, last] = range_edges(range_index);
+        for (size_t edge_index = first; edge_index < last; ++edge_index) {
+            list_node(edges_with_stops[edge_index].node_from);
+            list_node(edges_with_stops[edge_index].node_to);
         }
-        node.set_rank(node_to_rank.at(node.id));
-    };
+    }, 1);
 
-    // then we can rank the other nodes in the graph :
-    for (auto& edge : edges_with_stops) {
-        rank_that_node(edge.node_from);
-        rank_that_node(edge.node_to);
+    for (auto& new_nodes : ranges_new_nodes) {
+        for (uwpreprocess::NodeId node_id : new_nodes) {
+            if (node_to_rank.insert({node_id, current_rank}).second) {
+                ++current_rank;
+            }
+        }
+        new_nodes = {};
     }
 
+    parallel_for(nb_ranges, nb_threads, [&](size_t, size_t range_index) {
+        auto [first, last] = range_edges(range_index);
+        for (size_t edge_index = first; edge_index < last; ++edge_index) {
+            auto& edge = edges_with_stops[edge_index];
+            edge.node_from.set_rank(node_to_rank.at(edge.node_from.id));
+            edge.node_to.set_rank(node_to_rank.at(edge.node_to.id));
+        }
+    }, 1);
+
     size_t number_of_nodes = current_rank;  // rank starts at 0, so the number of nodes is highest-rank + 1
     return number_of_nodes;
 }
 
-vector<uwpreprocess::Edge> _add_reversed_edges(vector<uwpreprocess::Edge> const& edges) {
+vector<uwpreprocess::Edge> _add_reversed_edges(vector<uwpreprocess::Edge>&& edges,
+                                               GeometryArena const& geometries,
+                                               size_t nb_threads) {
     // For each edge, adds its reversed edge (this doubles the number of edges in the edgelist)
-    // note : if performance issues arise, the function would be faster with side-effects (mutating the edges)
-    // it is kept as is for now, as it is cleaner.
-    vector<uwpreprocess::Edge> bidirectional(edges);
-    for (auto edge : edges) {
-        Polyline reversed_geom = edge.geometry;
-        reverse(reversed_geom.begin(), reversed_geom.end());
-        bidirectional.emplace_back(edge.node_to.id, edge.node_to.get_rank(), edge.node_from.id,
-                                   edge.node_from.get_rank(), move(reversed_geom), edge.length_m, edge.weight);
+    // the reversed edge doesn't copy the geometry : it is a reversed view on the geometry of the forward edge.
+    // The edges are consumed and extended in place (no copy of the edgelist) : the reversed edge of the i-th edge is
+    // the (n+i)-th edge, thus the reversed edges are independent, and built concurrently.
+    size_t nb_forward_edges = edges.size();
+    if (nb_forward_edges == 0) {
+        return move(edges);
     }
-    assert(bidirectional.size() == 2 * edges.size());
+    // (Edge has no default constructor : the room of the reversed edges is first filled with copies of an edge)
+    edges.resize(2 * nb_forward_edges, edges.front());
+    constexpr const size_t EDGES_PER_CHUNK = 4096;
+    parallel_for(nb_forward_edges, nb_threads, [&edges, &geometries, nb_forward_edges](size_t, size_t edge_index) {
+        Edge const& edge = edges[edge_index];
+        edges[nb_forward_edges + edge_index] =
+            Edge{edge.node_to.id, edge.node_to.get_rank(), edge.node_from.id, edge.node_from.get_rank(),
+                 geometries, edge.geometry.reversed(), edge.length_m, edge.weight};
+    }, EDGES_PER_CHUNK);
 
     // FIXME : here, add a (debug only) check that the nodes of the graph are unchanged by this function
-    return bidirectional;
+    return move(edges);
 }
 
-vector<vector<size_t>> _map_nodes_to_out_edges(vector<uwpreprocess::Edge> const& edges, size_t nb_nodes) {
-    // this functions build a map that helps to retrieve the out-edges of a node (given its rank)
-    vector<vector<size_t>> node_to_out_edges(nb_nodes);
-    for (size_t edge_index = 0; edge_index < edges.size(); ++edge_index) {
-        auto const& edge = edges[edge_index];
-        node_to_out_edges[edge.node_from.get_rank()].push_back(edge_index);
-    }
-    return node_to_out_edges;
+CsrAdjacency _map_nodes_to_out_edges(vector<uwpreprocess::Edge> const& edges, size_t nb_nodes) {
+    // this functions build a structure that helps to retrieve the out-edges of a node (given its rank)
+    return CsrAdjacency::build(edges, nb_nodes);
 }
 
 WalkingGraph::WalkingGraph(filesystem::path osm_file,
                            BgPolygon polygon_,
                            vector<uwpreprocess::Stop> const& stops,
-                           float walkspeed_km_per_hour_)
+                           float walkspeed_km_per_hour_,
+                           size_t nb_threads)
     : walkspeed_km_per_hour{walkspeed_km_per_hour_},
       polygon{polygon_} {
 
+    // each stage consumes the edges of the previous stage (by move, or by mutating them in place) :
+    // this way, a single edge set is alive at any time.
+    start_memory_stage();
+
     // those are the original edges (the edges in the OSM data): 
-    auto edges_osm = osm_to_graph(osm_file, polygon, walkspeed_km_per_hour);
+    vector<Edge> edges = osm_to_graph(osm_file, polygon, walkspeed_km_per_hour, geometries, nb_threads);
+    build_from_osm_edges(move(edges), stops, nullptr, nb_threads);
+}
 
-    // those edges are the edges "augmented" with an edge between each stop and its closest original node :
-    vector<Edge> edges_with_stops;
-    tie(edges_with_stops, stops_with_closest_node) = extend_graph(stops, edges_osm, walkspeed_km_per_hour);
+WalkingGraph::WalkingGraph(vector<uwpreprocess::Edge>&& osm_edges,
+                           GeometryArena&& osm_geometries,
+                           BgPolygon polygon_,
+                           vector<uwpreprocess::Stop> const& stops,
+                           float walkspeed_km_per_hour_,
+                           PreviousSnapping const* previous_snapping,
+                           size_t nb_threads)
+    : geometries{move(osm_geometries)},
+      walkspeed_km_per_hour{walkspeed_km_per_hour_},
+      polygon{polygon_} {
+    start_memory_stage();
+    build_from_osm_edges(move(osm_edges), stops, previous_snapping, nb_threads);
+}
 
-    size_t nb_nodes = _rank_nodes(edges_with_stops, stops);
-    edges_with_stops_bidirectional = _add_reversed_edges(edges_with_stops);
-    node_to_out_edges = _map_nodes_to_out_edges(edges_with_stops_bidirectional, nb_nodes);
-    cout << "Number of nodes in the graph = " << node_to_out_edges.size() << endl;
+void WalkingGraph::build_from_osm_edges(vector<uwpreprocess::Edge>&& edges,
+                                        vector<uwpreprocess::Stop> const& stops,
+                                        PreviousSnapping const* previous_snapping,
+                                        size_t nb_threads) {
+    // the edges are then "augmented" with an edge between each stop and its closest original node :
+    stops_with_closest_node = extend_graph(stops, edges, walkspeed_km_per_hour, node_names, geometries,
+                                           previous_snapping, nb_threads);
+    print_memory_usage("extending with stops");
+
+    size_t nb_nodes = _rank_nodes(edges, stops, node_names, nb_threads);
+    print_memory_usage("ranking");
+
+    edges_with_stops_bidirectional = _add_reversed_edges(move(edges), geometries, nb_threads);
+    print_memory_usage("adding reversed edges");
+
+    out_edges = _map_nodes_to_out_edges(edges_with_stops_bidirectional, nb_nodes);
+    print_memory_usage("mapping nodes to out-edges");
+    cout << "Number of nodes in the graph = " << out_edges.nb_nodes() << endl;
     cout << "Number of edges in the graph = " << edges_with_stops_bidirectional.size() << endl;
+    cout << "Number of locations in the geometries = " << geometries.locations.size() << endl;
+    cout << "Memory used by the edge set = "
+         << edges_with_stops_bidirectional.capacity() * sizeof(Edge) / (1024 * 1024) << " MB" << endl;
     check_structures_consistency();
 }
 
+void WalkingGraph::add_weight_profile(float walkspeed_km_per_hour_) {
+    // The weight of any edge (OSM edges, with the speed factor of their way, as well as stop edges) is its length
+    // divided by the walkspeed : thus, the weights of another walkspeed are the weights of the edges, scaled.
+    // As all the weights are scaled by the same ratio, the shortest paths are the same for all the walkspeeds.
+    // (the division is made in double, so the weights only differ from those of a build with this walkspeed by the
+    // float rounding)
+    double ratio = static_cast<double>(walkspeed_km_per_hour) / walkspeed_km_per_hour_;
+    WeightProfile profile{walkspeed_km_per_hour_, {}};
+    profile.weights.reserve(edges_with_stops_bidirectional.size());
+    for (auto const& edge : edges_with_stops_bidirectional) {
+        profile.weights.push_back(static_cast<float>(edge.weight * ratio));
+    }
+    weight_profiles.push_back(move(profile));
+}
 
 void WalkingGraph::check_structures_consistency() const {
     // check structures consistency :
     //  - each node in the node-structure are used in at least one edge
     //  - each edge's extremities in the edge-structure exists in the node-strcture
+    //  - each edge is in the out-edges of its source node, with the same target and weight
     // FIXME : this should be used in debug settings only.
     set<size_t> nodes1;
     for (auto& edge : edges_with_stops_bidirectional) {
@@ -99,16 +192,34 @@ void WalkingGraph::check_structures_consistency() const {
     }
 
     set<size_t> nodes2;
-    for (size_t rank = 0; rank < node_to_out_edges.size(); ++ rank) {
+    for (size_t rank = 0; rank < out_edges.nb_nodes(); ++ rank) {
         nodes2.insert(rank);
     }
 
     if (nodes1 != nodes2) {
         cout << "ERROR : structures inconsistency :" << endl;
         cout << "nodes1 (used in vector<Edge>) is of size = " << nodes1.size() << endl;
-        cout << "nodes2 (used in node_to_out_edges) is of size = " << nodes2.size() << endl;
+        cout << "nodes2 (used in out_edges) is of size = " << nodes2.size() << endl;
         exit(1);
     }
+
+    if (out_edges.nb_edges() != edges_with_stops_bidirectional.size()) {
+        cout << "ERROR : structures inconsistency :" << endl;
+        cout << "vector<Edge> has " << edges_with_stops_bidirectional.size() << " edges, but out_edges has "
+             << out_edges.nb_edges() << endl;
+        exit(1);
+    }
+    for (size_t rank = 0; rank < out_edges.nb_nodes(); ++rank) {
+        for (auto out_edge : out_edges.out_edges(rank)) {
+            auto const& edge = edges_with_stops_bidirectional[out_edge.edge_index];
+            if (edge.node_from.get_rank() != rank || edge.node_to.get_rank() != out_edge.target ||
+                edge.weight != out_edge.weight) {
+                cout << "ERROR : structures inconsistency :" << endl;
+                cout << "out-edge of node " << rank << " doesn't match edge " << out_edge.edge_index << endl;
+                exit(1);
+            }
+        }
+    }
 }
 
 }  // namespace uwpreprocess
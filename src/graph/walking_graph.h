@@ -2,12 +2,21 @@
 
 #include <vector>
 #include <filesystem>
+#include <thread>
 
 #include "graph/graphtypes.h"
+#include "graph/adjacency.h"
+#include "graph/extending_with_stops.h"
 #include "graph/polygon.h"
 
 namespace uwpreprocess {
 
+// The weights of the edges of a walking-graph for another walkspeed :
+struct WeightProfile {
+    float walkspeed_km_per_hour;
+    std::vector<float> weights;  // weights[i] is the weight of the i-th edge of edges_with_stops_bidirectional
+};
+
 struct WalkingGraph {
     // From a set of stops and a given OSM file (+ a possible filtering polygon), computes a walking graph.
     //
@@ -20,24 +29,51 @@ struct WalkingGraph {
     WalkingGraph(std::filesystem::path osm_file,
                  BgPolygon polygon_,
                  std::vector<uwpreprocess::Stop> const& stops,
-                 float walkspeed_km_per_hour_);
+                 float walkspeed_km_per_hour_,
+                 size_t nb_threads = std::thread::hardware_concurrency());
+
+    // Same, but from the original edges and geometries already computed by osm_to_graph (e.g. loaded from a cache).
+    // If the snapping of a previous build is given, only the stops that may have a new closest node are snapped again.
+    WalkingGraph(std::vector<uwpreprocess::Edge>&& osm_edges,
+                 uwpreprocess::GeometryArena&& osm_geometries,
+                 BgPolygon polygon_,
+                 std::vector<uwpreprocess::Stop> const& stops,
+                 float walkspeed_km_per_hour_,
+                 PreviousSnapping const* previous_snapping = nullptr,
+                 size_t nb_threads = std::thread::hardware_concurrency());
 
     WalkingGraph(WalkingGraph&&) = default;
     WalkingGraph() {}
 
     void check_structures_consistency() const;
 
+    // adds the weights of the edges for another walkspeed (without building the graph again) :
+    void add_weight_profile(float walkspeed_km_per_hour_);
+
     // edges in graph OSM + an additional edge for each stops + all edges are duplicated to make them bidirectional :
     std::vector<uwpreprocess::Edge> edges_with_stops_bidirectional;
 
-    // helper structures :
-    std::vector<std::vector<size_t>> node_to_out_edges;
+    // the geometries of the edges (a reversed edge shares the geometry of its forward edge) :
+    uwpreprocess::GeometryArena geometries;
 
-    float walkspeed_km_per_hour;
+    // helper structure, to retrieve the out-edges of a node (given its rank) :
+    uwpreprocess::CsrAdjacency out_edges;
+
+    // the names (ids and urls) of the nodes, used for serialization :
+    uwpreprocess::NodeNames node_names;
+
+    float walkspeed_km_per_hour;  // the walkspeed of the weights of the edges themselves
+    std::vector<WeightProfile> weight_profiles;  // the weights of the edges for other walkspeeds (if any)
     uwpreprocess::BgPolygon polygon;
 
     // those are the stops passed as parameters, augmented with their closest node in the OSM graph :
     std::vector<uwpreprocess::StopWithClosestNode> stops_with_closest_node;
+
+   private:
+    void build_from_osm_edges(std::vector<uwpreprocess::Edge>&& edges,
+                              std::vector<uwpreprocess::Stop> const& stops,
+                              PreviousSnapping const* previous_snapping,
+                              size_t nb_threads);
 };
 
 }  // namespace uwpreprocess
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <numeric>
+
+#include "graph/ways_storage.h"
+
+using namespace std;
+
+namespace uwpreprocess {
+
+void WaysNodes::append(WaysNodes const& other) {
+    size_t shift = nodes.size();
+    way_ids.insert(way_ids.end(), other.way_ids.begin(), other.way_ids.end());
+    speed_factors.insert(speed_factors.end(), other.speed_factors.begin(), other.speed_factors.end());
+    for (auto ite = other.offsets.begin() + 1; ite != other.offsets.end(); ++ite) {
+        offsets.push_back(*ite + shift);
+    }
+    nodes.insert(nodes.end(), other.nodes.begin(), other.nodes.end());
+}
+
+WaysNodes WaysNodes::extract(vector<size_t> const& way_indexes) const {
+    WaysNodes extracted;
+    extracted.way_ids.reserve(way_indexes.size());
+    extracted.speed_factors.reserve(way_indexes.size());
+    extracted.offsets.reserve(way_indexes.size() + 1);
+    for (size_t way_index : way_indexes) {
+        WayNodes way = way_nodes(way_index);
+        extracted.nodes.insert(extracted.nodes.end(), way.begin(), way.end());
+        extracted.close_way(way_ids[way_index], speed_factors[way_index]);
+    }
+    return extracted;
+}
+
+void WaysNodes::clear() {
+    way_ids.clear();
+    speed_factors.clear();
+    offsets.assign(1, 0);
+    nodes.clear();
+}
+
+vector<size_t> WaysNodes::ordered_by_way_id() const {
+    vector<size_t> order(size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [this](size_t left, size_t right) {
+        return way_ids[left] < way_ids[right];
+    });
+    auto new_end = unique(order.begin(), order.end(), [this](size_t left, size_t right) {
+        return way_ids[left] == way_ids[right];
+    });
+    order.erase(new_end, order.end());
+    return order;
+}
+
+constexpr const size_t INITIAL_CAPACITY = 1024;  // must be a power of 2
+
+NodeUseCounter::NodeUseCounter() : slots(INITIAL_CAPACITY) {}
+
+static inline size_t _hash(NodeOsmId node_id) {
+    // mixing function of splitmix64 (OSM ids are sequential, so they must be scrambled before masking)
+    uint64_t x = static_cast<uint64_t>(node_id);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return static_cast<size_t>(x ^ (x >> 31));
+}
+
+size_t NodeUseCounter::find_slot(NodeOsmId node_id) const {
+    // returns the slot of the node, or the empty slot where it should be inserted
+    size_t mask = slots.size() - 1;
+    size_t index = _hash(node_id) & mask;
+    while (slots[index].node_id != node_id && slots[index].node_id != EMPTY_SLOT) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void NodeUseCounter::grow() {
+    vector<Slot> old_slots(2 * slots.size());
+    swap(old_slots, slots);
+    for (auto const& slot : old_slots) {
+        if (slot.node_id != EMPTY_SLOT) {
+            slots[find_slot(slot.node_id)] = slot;
+        }
+    }
+}
+
+void NodeUseCounter::increment(NodeOsmId node_id, int increment) {
+    size_t index = find_slot(node_id);
+    if (slots[index].node_id == EMPTY_SLOT) {
+        // the load factor is kept below 1/2, to keep the probe sequences short :
+        if (2 * (nb_used_slots + 1) > slots.size()) {
+            grow();
+            index = find_slot(node_id);
+        }
+        slots[index].node_id = node_id;
+        ++nb_used_slots;
+    }
+    slots[index].counter += increment;
+}
+
+int NodeUseCounter::count(NodeOsmId node_id) const {
+    return slots[find_slot(node_id)].counter;
+}
+
+void NodeUseCounter::merge(NodeUseCounter const& other) {
+    for (auto const& slot : other.slots) {
+        if (slot.node_id != EMPTY_SLOT) {
+            increment(slot.node_id, slot.counter);
+        }
+    }
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include "graph/types.h"
+
+// this module defines the flat structures used to store the OSM ways (and their nodes) after parsing.
+
+namespace uwpreprocess {
+
+// A WayNodes is a (non-owning) view on the nodes of a given way :
+struct WayNodes {
+    LocatedNode const* first;
+    LocatedNode const* last;
+    inline LocatedNode const* begin() const { return first; }
+    inline LocatedNode const* end() const { return last; }
+    inline size_t size() const { return last - first; }
+};
+
+// WaysNodes stores the nodes of all the ways in a single contiguous array :
+// the nodes of the i-th way are nodes[offsets[i]] to nodes[offsets[i+1] - 1]
+struct WaysNodes {
+    std::vector<WayId> way_ids;
+    std::vector<float> speed_factors;  // factor applied to the walkspeed on the i-th way (see pedestrian_profile.h)
+    std::vector<size_t> offsets{0};
+    std::vector<LocatedNode> nodes;
+
+    inline size_t size() const { return way_ids.size(); }
+    inline WayNodes way_nodes(size_t way_index) const {
+        return {nodes.data() + offsets[way_index], nodes.data() + offsets[way_index + 1]};
+    }
+
+    // to add a way, its nodes are pushed in 'nodes', and then the way is closed :
+    inline void close_way(WayId way_id, float speed_factor) {
+        way_ids.push_back(way_id);
+        speed_factors.push_back(speed_factor);
+        offsets.push_back(nodes.size());
+    }
+
+    void append(WaysNodes const& other);
+    WaysNodes extract(std::vector<size_t> const& way_indexes) const;  // copy of the given ways, in the given order
+    void clear();
+
+    // returns the way indexes, ordered by way id (if a way id is duplicated, only its first occurrence is kept) :
+    std::vector<size_t> ordered_by_way_id() const;
+};
+
+// NodeUseCounter counts, for a given node, how many ways use it.
+// It is an open-addressing hash table (linear probing), with a single probe sequence per increment.
+class NodeUseCounter {
+   public:
+    NodeUseCounter();
+
+    void increment(NodeOsmId node_id, int increment = 1);
+    int count(NodeOsmId node_id) const;  // returns 0 for an unknown node
+    void merge(NodeUseCounter const& other);
+    inline size_t size() const { return nb_used_slots; }
+
+   private:
+    static constexpr const NodeOsmId EMPTY_SLOT = std::numeric_limits<NodeOsmId>::min();
+    struct Slot {
+        NodeOsmId node_id = EMPTY_SLOT;
+        int counter = 0;
+    };
+
+    size_t find_slot(NodeOsmId node_id) const;
+    void grow();
+
+    std::vector<Slot> slots;
+    size_t nb_used_slots = 0;
+};
+
+}  // namespace uwpreprocess
@@ -1,43 +1,67 @@
+#include <algorithm>
+#include <cassert>
+#include <memory>
 #include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 
-#include "ad/cppgtfs/Parser.h"
-
+#include "common/parallel.h"
 #include "gtfs_parsed_data.h"
+#include "gtfs_reader.h"
 
 using namespace std;
 
 namespace uwpreprocess {
 
-// note : the dependency to cppgtfs is isolated in static functions in cpp (instead of exposed in headers) :
+// The stops of the feed are interned : a stop is identified by its index in the table of the interned stop ids
+// (which is the index of the stop in the stops of the reader).
+// All the stops are interned before the partitioning, so that the table is only read (thus shared) by the threads.
+struct _InternedStops {
+    explicit _InternedStops(GtfsReader const& reader) {
+        indexes.reserve(reader.stops().size());
+        for (auto const& stop : reader.stops()) {
+            indexes.insert({stop.id, static_cast<StopIndex>(stop_ids.size())});
+            stop_ids.emplace_back(stop.id);
+        }
+    }
 
-static RouteLabel _trip_to_route_label(ad::cppgtfs::gtfs::Trip const& trip) {
-    RouteLabel to_return;
-    // build the label of the trip's route (scientific route, see below).
-    // A route label is just the concatenation of its stop's ids :
-    //     32+33+34+122+123+125+126
-    // precondition : no stopID constains the delimiter '+'
+    StopIndex index(string_view stop_id) const {
+        auto found = indexes.find(stop_id);
+        if (found == indexes.end())
+            throw runtime_error("ERROR : a trip uses the stop '" + string(stop_id) + "' that is not in the feed");
+        return found->second;
+    }
 
-    if (trip.getStopTimes().size() < 2) {
+    unordered_map<string_view, StopIndex> indexes;  // (the views point into the stops of the reader)
+    vector<string> stop_ids;
+};
+
+static RouteKey _trip_to_route_key(GtfsTripStopTimes const& trip, _InternedStops const& interned_stops) {
+    // build the key of the trip's route (scientific route, see below) : the sequence of its (interned) stops
+
+    if (trip.stoptimes.size() < 2) {
         ostringstream oss;
-        oss << "ERROR : route is too small (" << trip.getStopTimes().size() << ") of trip : " << trip.getId();
+        oss << "ERROR : route is too small (" << trip.stoptimes.size() << ") of trip : " << trip.trip_id;
         throw runtime_error(oss.str());
     }
 
-    string route_id{};
+    vector<StopIndex> stops;
+    stops.reserve(trip.stoptimes.size());
 
 #ifndef NDEBUG
     int previous_departure_time = -1;
 #endif
 
-    // precondition : getStopTimes return stops in order
-    for (auto const& stoptime : trip.getStopTimes()) {
-        auto stop = *(stoptime.getStop());
-        route_id.append(stop.getId());
-        route_id.append("+");
+    // precondition : the stoptimes are ordered by stop_sequence
+    for (auto const& stoptime : trip.stoptimes) {
+        stops.push_back(interned_stops.index(stoptime.stop_id));
 
 #ifndef NDEBUG
         // verifying that stop times are properly ordered :
-        int current_departure_time = stoptime.getDepartureTime().seconds();
+        int current_departure_time = stoptime.departure_time;
         if (current_departure_time <= previous_departure_time) {
             throw runtime_error("ERROR : stoptimes are not properly ordered !");
         }
@@ -45,135 +69,279 @@ static RouteLabel _trip_to_route_label(ad::cppgtfs::gtfs::Trip const& trip) {
 #endif
     }
 
-    // remove final '+' :
-    to_return.label = route_id.substr(0, route_id.size() - 1);
-    return to_return;
+    return RouteKey{move(stops)};
 }
 
-void _add_trip_to_route(ParsedRoute& route, OrderableTripId const& trip_id, ad::cppgtfs::gtfs::Trip const& trip) {
-    auto& this_trip_events = route.trips[trip_id];
-    for (auto const& stoptime : trip.getStopTimes()) {
-        int arrival_time = stoptime.getArrivalTime().seconds();
-        int departure_time = stoptime.getDepartureTime().seconds();
-        this_trip_events.emplace_back(arrival_time, departure_time);
-    }
+// A trip of the feed is kept as one or several copies (or none, if its service is not active in the service window) :
+//  - without service window, each trip is kept as is
+//  - with a service window, only the trips whose service is active on at least a day of the window are kept
+//  - if the days are unrolled, a trip is kept once per active day, its times being shifted to that day
+// The trips of the day before the window that run after midnight (times >= 24:00) are also running during the window :
+// their copy of the day before is shifted by -24 hours, and is only kept (see _is_copy_retained) if the trip is still
+// running at the beginning of the window (i.e. if its last stop time is >= 24:00) : its first times may be negative.
+// Without unrolling, such a copy is only used if the service of the trip isn't active on a day of the window.
+struct _TripCopy {
+    TripIndex trip_index;  // (in the table of trip ids)
+    int time_offset;       // seconds
+};
+
+static bool _is_copy_retained(_TripCopy const& copy, GtfsTripStopTimes const& trip) {
+    // (a copy shifted before the window is only kept if the trip is still running at the beginning of the window)
+    return copy.time_offset >= 0 || trip.stoptimes.back().arrival_time + copy.time_offset >= 0;
 }
 
-static ad::cppgtfs::gtfs::Stop const& _get_stop(ad::cppgtfs::gtfs::Feed const& feed, string const& stopid) {
-    auto stop_ptr = feed.getStops().get(stopid);
-    if (stop_ptr == 0) {
-        ostringstream oss;
-        oss << "ERROR : unable to get stop with id '" << stopid << "' (stop_ptr is 0)";
-        throw runtime_error(oss.str());
+struct _RetainedTrips {
+    // the copies of the i-th trip of trips.txt are copies[first_copy[i]] ... copies[first_copy[i + 1] - 1]
+    vector<size_t> first_copy;
+    vector<_TripCopy> copies;
+    shared_ptr<TripIds const> trip_ids;
+
+    // (once the stop times of the trip are known) :
+    size_t nb_retained_copies(GtfsTripStopTimes const& trip) const {
+        size_t nb_retained = 0;
+        for (size_t copy = first_copy[trip.trip_index]; copy < first_copy[trip.trip_index + 1]; ++copy) {
+            nb_retained += _is_copy_retained(copies[copy], trip);
+        }
+        return nb_retained;
+    }
+};
+
+static _RetainedTrips _retain_trips(GtfsReader const& reader, optional<ServiceWindow> const& service_window) {
+    auto const& reader_trip_ids = reader.trip_ids();
+    _RetainedTrips retained;
+    retained.first_copy.reserve(reader_trip_ids.size() + 1);
+    retained.first_copy.push_back(0);
+    auto trip_ids = make_shared<TripIds>();
+
+    if (!service_window) {
+        trip_ids->assign(reader_trip_ids.begin(), reader_trip_ids.end());
+        for (TripIndex trip = 0; trip < reader_trip_ids.size(); ++trip) {
+            retained.copies.push_back({trip, 0});
+            retained.first_copy.push_back(retained.copies.size());
+        }
+        retained.trip_ids = move(trip_ids);
+        return retained;
     }
 
-    return *stop_ptr;
+    // (the day before the window is also queried, for the trips that run after midnight) :
+    ServiceWindow extended_window = *service_window;
+    extended_window.first_day -= 1;
+    vector<vector<GtfsDay>> services_active_days = reader.services_active_days(extended_window);
+    for (size_t trip = 0; trip < reader_trip_ids.size(); ++trip) {
+        auto const& active_days = services_active_days[reader.trip_services()[trip]];
+        if (!service_window->unroll_days && !active_days.empty()) {
+            int time_offset = active_days.back() >= service_window->first_day ? 0 : -24 * 3600;
+            retained.copies.push_back({static_cast<TripIndex>(trip_ids->size()), time_offset});
+            trip_ids->emplace_back(reader_trip_ids[trip]);
+        } else if (service_window->unroll_days) {
+            for (GtfsDay day : active_days) {
+                int time_offset = (day - service_window->first_day) * 24 * 3600;
+                retained.copies.push_back({static_cast<TripIndex>(trip_ids->size()), time_offset});
+                trip_ids->push_back(string(reader_trip_ids[trip]) + "@" + format_gtfs_date(day));
+            }
+        }
+        retained.first_copy.push_back(retained.copies.size());
+    }
+    retained.trip_ids = move(trip_ids);
+    return retained;
 }
 
-static map<RouteLabel, ParsedRoute> _partition_trips_in_routes(ad::cppgtfs::gtfs::Feed const& feed) {
-    // This function partitions the trips of the GTFS feed, according to their stops.
-    // All The trips with exactly the same set of stops are grouped into a (scientific) 'route'.
-    // Once partitionned, a (scientific) route is identified by its RouteLabel.
-    // Two trips will have the same route label IF they have excatly the same sequence of stops.
+void _add_trip_to_route(ParsedRoute& route, _TripCopy const& copy, GtfsTripStopTimes const& trip) {
+    // (the trips are ordered later, once the route has all its trips)
+    route.add_trip(copy.trip_index);
+    for (auto const& stoptime : trip.stoptimes) {
+        route.add_event(stoptime.arrival_time + copy.time_offset, stoptime.departure_time + copy.time_offset);
+    }
+}
 
-    map<RouteLabel, ParsedRoute> parsed_routes;
+using PartitionedRoutes = unordered_map<RouteKey, ParsedRoute, RouteKeyHasher>;
 
-    for (auto const& [trip_id, trip_ptr] : feed.getTrips()) {
-        auto& trip = *(trip_ptr);
+// number of trips handed at once by the reader to the threads :
+constexpr const size_t TRIPS_BATCH_SIZE = 1 << 14;
 
-        // in the set, all the trips of a given route are ordered by their departure times
-        // precondition = each trip has at least a stop
-        int trip_departure_time_seconds = trip.getStopTimes().begin()->getDepartureTime().seconds();
+static PartitionedRoutes _partition_trips_in_routes(GtfsReader const& reader,
+                                                    _InternedStops const& interned_stops,
+                                                    _RetainedTrips const& retained_trips,
+                                                    size_t nb_threads,
+                                                    size_t& nb_partitioned_trips) {
+    // This function partitions the trips of the GTFS feed, according to their stops.
+    // All The trips with exactly the same set of stops are grouped into a (scientific) 'route'.
+    // Once partitionned, a (scientific) route is identified by its RouteKey (and later, by its RouteLabel).
+    // Two trips will have the same route key IF they have excatly the same sequence of stops.
+    // Only the retained trips (see above) are partitioned : the discarded ones are not even checked.
+    //
+    // The trips are streamed by the reader, by batches : the trips of a batch are partitioned concurrently, each
+    // thread filling its own maps (one per shard of the route keys). Once all the trips are read, the maps of each
+    // shard are merged concurrently (the nodes of the maps are moved, and the trips of a route appended).
+    // The trips of a route are then ordered by (departure time, trip id) whatever the thread that partitioned them,
+    // and the routes are later ranked by label : thus, the result doesn't depend on the number of threads.
+    nb_threads = max(nb_threads, size_t{1});
+    size_t nb_shards = nb_threads;
+    vector<vector<PartitionedRoutes>> threads_shards(nb_threads, vector<PartitionedRoutes>(nb_shards));
+    nb_partitioned_trips = 0;
+    auto partition_batch = [&](vector<GtfsTripStopTimes>& trips_batch) {
+        for (auto const& trip : trips_batch) {
+            nb_partitioned_trips += retained_trips.nb_retained_copies(trip);
+        }
+        parallel_for(trips_batch.size(), nb_threads, [&](size_t thread_index, size_t trip_index) {
+            GtfsTripStopTimes const& trip = trips_batch[trip_index];
+            if (retained_trips.nb_retained_copies(trip) == 0)
+                return;
+            RouteKey route_key = _trip_to_route_key(trip, interned_stops);
+            size_t shard_index = route_key.hash % nb_shards;
+            size_t nb_stops = route_key.stops.size();
+            auto& shard = threads_shards[thread_index][shard_index];
+            ParsedRoute& parsed_route =
+                shard.try_emplace(move(route_key), nb_stops, retained_trips.trip_ids).first->second;
+            for (size_t copy = retained_trips.first_copy[trip.trip_index];
+                 copy < retained_trips.first_copy[trip.trip_index + 1]; ++copy) {
+                if (_is_copy_retained(retained_trips.copies[copy], trip))
+                    _add_trip_to_route(parsed_route, retained_trips.copies[copy], trip);
+            }
+        });
+    };
+    // (if the rows of the trips are not grouped in stop_times.txt, the reader hands all the trips again) :
+    auto discard_partitioned_trips = [&]() {
+        threads_shards.assign(nb_threads, vector<PartitionedRoutes>(nb_shards));
+        nb_partitioned_trips = 0;
+    };
+    reader.for_each_trips_batch(TRIPS_BATCH_SIZE, partition_batch, discard_partitioned_trips);
+
+    vector<PartitionedRoutes> shards(nb_shards);
+    parallel_for(nb_shards, nb_threads, [&](size_t, size_t shard_index) {
+        PartitionedRoutes& shard = shards[shard_index];
+        for (auto& thread_shards : threads_shards) {
+            PartitionedRoutes& thread_shard = thread_shards[shard_index];
+            shard.merge(thread_shard);  // moves the routes that are not in the shard yet...
+            for (auto& [route_key, route] : thread_shard) {
+                shard.at(route_key).append(move(route));  // ... and the trips of the other ones
+            }
+            thread_shard = {};
+        }
+        // in each route, all the trips are ordered by their departure times (then by their ids) :
+        for (auto& [_, route] : shard) {
+            route.sort_trips();
+        }
+    }, 1);
 
-        RouteLabel route_label = _trip_to_route_label(trip);
-        ParsedRoute& parsed_route = parsed_routes[route_label];
-        _add_trip_to_route(parsed_route, {trip_departure_time_seconds, trip_id}, trip);
+    PartitionedRoutes parsed_routes;
+    for (auto& shard : shards) {
+        parsed_routes.merge(shard);  // (the shards have no route in common)
     }
-
     return parsed_routes;
 }
 
-[[maybe_unused]] static bool _check_route_partition_consistency(ad::cppgtfs::gtfs::Feed const& feed,
+[[maybe_unused]] static bool _check_route_partition_consistency(size_t nb_trips_in_feed,
                                                              map<RouteLabel, ParsedRoute> const& partition) {
     // checks that the agregation of the trips of all routes have the same number of trips than feed
-    auto nb_trips_in_feed = feed.getTrips().size();
     size_t nb_trips_in_partitions = accumulate(partition.cbegin(), partition.cend(), 0, [](size_t acc, auto const& route_pair) {
         auto const& route = route_pair.second;
-        return acc + route.trips.size();
+        return acc + route.nb_trips();
     });
     return nb_trips_in_feed == nb_trips_in_partitions;
 }
 
-static pair<vector<RouteLabel>, unordered_map<RouteLabel, size_t>> _rank_routes(
-    map<RouteLabel, ParsedRoute> const& routes) {
-    // this function ranks the partitioned routes
-    // i.e. each route has an arbitrary rank from 0 to N-1 (where N is the number of routes)
-    // (this rank will be used to store the routes in a vector)
-
-    size_t routeRank = 0;
-    vector<RouteLabel> ranked_routes;
-    unordered_map<RouteLabel, size_t> route_to_rank;
-
-    for (auto& [route_label, _] : routes) {
-        ranked_routes.push_back(route_label);
-        route_to_rank.insert({route_label, routeRank++});
-    }
-
-    // Here :
-    //   - ranked_routes associates a rank to a route
-    //   - route_to_rank allows to retrieve the rank of a given route
-    return {move(ranked_routes), move(route_to_rank)};
-}
-
-static pair<vector<ParsedStop>, unordered_map<string, size_t>> _rank_stops(map<RouteLabel, ParsedRoute> const& routes,
-                                                                          ad::cppgtfs::gtfs::Feed const& feed) {
+static pair<vector<ParsedStop>, vector<size_t>> _rank_stops(vector<string> const& interned_stop_ids,
+                                                            PartitionedRoutes const& routes,
+                                                            vector<GtfsStop> const& stops) {
     // this function ranks the stops (and filter them : stops not used in at least a route are ignored)
     // i.e. each stop has an arbitrary rank from 0 to N-1 (where N is the number of stops)
     // (this rank will be used to store the stops in a vector)
 
     // first, identify the stops that are used by at least one route :
-    set<string> useful_stop_ids;
-    for (auto& [route_label, _] : routes) {
-        vector<string> stops_of_this_route = route_label.to_stop_ids();
-        useful_stop_ids.insert(stops_of_this_route.begin(), stops_of_this_route.end());
+    vector<char> is_stop_used(interned_stop_ids.size(), false);
+    for (auto const& [route_key, _] : routes) {
+        for (StopIndex stop : route_key.stops) {
+            is_stop_used[stop] = true;
+        }
     }
 
-    // then, rank them :
-    size_t rank = 0;
+    // then, rank them (by id) :
+    vector<StopIndex> useful_stops;
+    for (StopIndex stop = 0; stop < interned_stop_ids.size(); ++stop) {
+        if (is_stop_used[stop])
+            useful_stops.push_back(stop);
+    }
+    sort(useful_stops.begin(), useful_stops.end(), [&interned_stop_ids](StopIndex left, StopIndex right) {
+        return interned_stop_ids[left] < interned_stop_ids[right];
+    });
+
     vector<ParsedStop> ranked_stops;
-    unordered_map<string, size_t> stopid_to_rank;
-    for (auto& stopid : useful_stop_ids) {
-        Stop const& stop = _get_stop(feed, stopid);
-        ranked_stops.emplace_back(stopid, stop.getName(), stop.getLat(), stop.getLng());
-        stopid_to_rank.insert({stopid, rank});
-        ++rank;
+    vector<size_t> interned_stop_to_rank(interned_stop_ids.size());
+    for (size_t rank = 0; rank < useful_stops.size(); ++rank) {
+        GtfsStop const& stop = stops[useful_stops[rank]];
+        ranked_stops.emplace_back(interned_stop_ids[useful_stops[rank]], string(stop.name), stop.latitude,
+                                  stop.longitude);
+        interned_stop_to_rank[useful_stops[rank]] = rank;
     }
 
     // Here :
     //   - ranked_stops associates a rank to a stop
-    //   - stopid_to_rank allows to retrieve the rank of a given stop
-    return {move(ranked_stops), move(stopid_to_rank)};
+    //   - interned_stop_to_rank allows to retrieve the rank of a given (used) interned stop
+    return {move(ranked_stops), move(interned_stop_to_rank)};
 }
 
-GtfsParsedData::GtfsParsedData(string const& gtfs_folder) {
-    ad::cppgtfs::Parser parser;
-    ad::cppgtfs::gtfs::Feed feed;
-    parser.parse(&feed, gtfs_folder);
+GtfsParsedData::GtfsParsedData(string const& gtfs_folder,
+                               size_t nb_threads,
+                               optional<ServiceWindow> const& service_window) {
+    GtfsReader reader{gtfs_folder};
+
+    _InternedStops interned_stops{reader};
+    _RetainedTrips retained_trips = _retain_trips(reader, service_window);
+    size_t nb_trips = 0;
+    PartitionedRoutes partitioned_routes =
+        _partition_trips_in_routes(reader, interned_stops, retained_trips, nb_threads, nb_trips);
+
+    vector<size_t> interned_stop_to_rank;
+    tie(ranked_stops, interned_stop_to_rank) =
+        _rank_stops(interned_stops.stop_ids, partitioned_routes, reader.stops());
+    for (size_t rank = 0; rank < ranked_stops.size(); ++rank) {
+        stopid_to_rank.insert({ranked_stops[rank].id, rank});
+    }
+
+    // the label of each route is built once, and the routes are ranked by label :
+    vector<pair<RouteLabel, PartitionedRoutes::iterator>> labelled_routes;
+    labelled_routes.reserve(partitioned_routes.size());
+    for (auto ite = partitioned_routes.begin(); ite != partitioned_routes.end(); ++ite) {
+        labelled_routes.emplace_back(RouteLabel{ite->first, interned_stops.stop_ids}, ite);
+    }
+    sort(labelled_routes.begin(), labelled_routes.end(),
+         [](auto const& left, auto const& right) { return left.first.label < right.first.label; });
+
+    // two different routes may have the same label, if a stop id contains the separator of the label (the second one
+    // would then silently replace the first one) :
+    auto duplicate =
+        adjacent_find(labelled_routes.begin(), labelled_routes.end(),
+                      [](auto const& left, auto const& right) { return left.first.label == right.first.label; });
+    if (duplicate != labelled_routes.end()) {
+        throw runtime_error("ERROR : several routes have the same label (a stop id contains '+' ?) : '" +
+                            duplicate->first.label + "'");
+    }
 
-    routes = _partition_trips_in_routes(feed);
+    // i.e. each route has an arbitrary rank from 0 to N-1 (where N is the number of routes)
+    // (this rank will be used to store the routes in a vector)
+    ranked_routes_stops.reserve(labelled_routes.size());
+    for (auto& [route_label, route] : labelled_routes) {
+        vector<size_t> stop_ranks;
+        stop_ranks.reserve(route->first.stops.size());
+        for (StopIndex stop : route->first.stops) {
+            stop_ranks.push_back(interned_stop_to_rank[stop]);
+        }
+        ranked_routes_stops.push_back(move(stop_ranks));
+        route_to_rank.insert({route_label, ranked_routes.size()});
+        ranked_routes.push_back(route_label);
+        routes.emplace_hint(routes.end(), move(route_label), move(route->second));
+    }
 
 #ifndef NDEBUG
-    bool is_partition_consistent = _check_route_partition_consistency(feed, routes);
+    bool is_partition_consistent = _check_route_partition_consistency(nb_trips, routes);
     if (!is_partition_consistent) {
         ostringstream oss;
         oss << "ERROR : number of trips after partitioning by route is not the same than number of trips in feed (="
-            << feed.getTrips().size() << ")";
+            << nb_trips << ")";
         throw runtime_error(oss.str());
     }
 #endif
-
-    tie(ranked_routes, route_to_rank) = _rank_routes(routes);
-    tie(ranked_stops, stopid_to_rank) = _rank_stops(routes, feed);
 }
 
 void GtfsParsedData::to_hluw_stoptimes(std::ostream& out) const {
@@ -183,19 +351,21 @@ void GtfsParsedData::to_hluw_stoptimes(std::ostream& out) const {
     // these fields are the only ones that are relevant :
     out << "trip_id,arrival_time,departure_time,stop_id,stop_sequence\n";
 
+    // (the routes are ranked in the order of their labels, which is the order of the routes map)
+    size_t route_rank = 0;
     for (auto& [route_label, parsed_route] : routes) {
         // the stops of this route :
-        vector<string> const& stop_ids = route_label.to_stop_ids();
+        vector<size_t> const& stop_ranks = ranked_routes_stops[route_rank++];
 
         // the events of each trips :
-        for (auto& [orderable_trip_id, events] : parsed_route.trips) {
-            assert(stop_ids.size() == events.size());
+        for (auto const& [orderable_trip_id, events] : parsed_route.trips()) {
+            assert(stop_ranks.size() == events.size());
             auto const& trip_id = orderable_trip_id.second;
             size_t stop_sequence = 1;  // in GTFS, stop sequence seem to begin at 1
-            for (auto& [arrival_time, departure_time] : events) {
+            for (auto const& [arrival_time, departure_time] : events) {
                 // FIXME : this assumes that trip AND stop ids don't need escaping
-                out << trip_id << "," << arrival_time << "," << departure_time << "," << stop_ids[stop_sequence - 1]
-                    << "," << stop_sequence << "\n";
+                out << trip_id << "," << arrival_time << "," << departure_time << ","
+                    << ranked_stops[stop_ranks[stop_sequence - 1]].id << "," << stop_sequence << "\n";
                 ++stop_sequence;
             }
         }
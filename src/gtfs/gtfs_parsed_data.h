@@ -2,33 +2,42 @@
 
 #include <vector>
 #include <functional>
+#include <optional>
+#include <thread>
 
 #include "gtfs_parsing_structures.h"
+#include "service_calendar.h"
 
 // From a given GTFS feed, GtfsParsedData is an abstraction of the GTFS data, suitable for ULTRA :
 //  - only the stops that appear in at least one trip are kept (unused stops are ignored)
+//  - if a service window is given, only the trips whose service is active during the window are kept (possibly
+//    unrolled, once per active day), and everything else (routes, stops, ranks) only derives from the kept trips
 //  - trips are partitionned into "scientific" routes (about routes, see details below)
 //  - routes and stops are ranked (about ranks, see details below)
 //  - a route (or a stop) can be identified with either its "ID" (RouteLabel/StopId) or its rank
+//    (while partitioning, a route is identified by a RouteKey, its sequence of interned stops)
 //  - the conversion between ID<->rank is done with the conversion structures
 
-// NOTE : the code that builds GtfsParsedData is currently tightly coupled to cppgtfs, the gtfs-parsing library
+// NOTE : the feed is read by GtfsReader (see gtfs_reader.h), that only reads stops.txt, trips.txt and stop_times.txt
 
 // WARNING : there are two mismatching definitions of the word "route" :
 //  - what scientific papers calls "route" is a particular set of stops
 //    in particular, if two trips travel between exactly the same stops, they belong to the same route.
-//  - what GTFS standard (and thus cppgtfs) calls "route" is just a given structure associated to a trip
+//  - what GTFS standard (routes.txt) calls "route" is just a given structure associated to a trip
 //    but this association is arbitrary : in GTFS data, two trips can use the same "route" structure
 //    even if they don't use exactly the same set of stops
 //
 // In general, in ULTRA code (and in code building ULTRA data), the "routes" are the scientific ones.
 // Thus, one of the main purpose of GtfsParsedData is to build "scientific" routes from GTFS feed.
-// BEWARE : the "routes" returned by cppgtfs are not the scientific ones, and they are NOT further used !
+// BEWARE : the "routes" of routes.txt are not the scientific ones, and they are NOT even read !
 
 namespace uwpreprocess {
 
 struct GtfsParsedData {
-    GtfsParsedData(std::string const& gtfsFolder);
+    // (the trips are partitioned in routes by several threads, the result doesn't depend on their number)
+    GtfsParsedData(std::string const& gtfsFolder,
+                   size_t nb_threads = std::thread::hardware_concurrency(),
+                   std::optional<ServiceWindow> const& service_window = std::nullopt);
     inline GtfsParsedData(){};
 
     std::map<RouteLabel, ParsedRoute> routes;
@@ -48,12 +57,17 @@ struct GtfsParsedData {
     std::vector<ParsedStop> ranked_stops;
     std::unordered_map<std::string, size_t> stopid_to_rank;
 
+    //   - ranked_routes_stops associates to each route rank the ranks of the stops of the route (in route order)
+    //     (the routes are ranked in the order of their labels)
+    std::vector<std::vector<size_t>> ranked_routes_stops;
+
     // serialization/deserialization :
     void to_hluw_stoptimes(std::ostream& out) const;  // FIXME : this should be in HL-UW repo
 
     inline bool operator==(GtfsParsedData const& other) const {
         return (ranked_routes == other.ranked_routes && route_to_rank == other.route_to_rank &&
-                ranked_stops == other.ranked_stops && stopid_to_rank == other.stopid_to_rank && routes == other.routes);
+                ranked_stops == other.ranked_stops && stopid_to_rank == other.stopid_to_rank &&
+                routes == other.routes && ranked_routes_stops == other.ranked_routes_stops);
     }
 };
 
@@ -1,5 +1,8 @@
 #include <sstream>
+#include <algorithm>
 #include <cmath>
+#include <functional>
+#include <numeric>
 
 #include "gtfs_parsing_structures.h"
 
@@ -7,6 +10,22 @@ using namespace std;
 
 namespace uwpreprocess {
 
+RouteKey::RouteKey(vector<StopIndex>&& stops_) : stops{move(stops_)}, hash{stops.size()} {
+    // (same combination as boost::hash_combine)
+    for (StopIndex stop : stops) {
+        hash ^= std::hash<StopIndex>{}(stop) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+}
+
+RouteLabel::RouteLabel(RouteKey const& key, vector<string> const& stop_ids) {
+    // a route label is the concatenation of its stop's ids, separated by '+' (e.g. 32+33+34+122+123+125+126) :
+    for (size_t position = 0; position < key.stops.size(); ++position) {
+        if (position > 0)
+            label.push_back('+');
+        label.append(stop_ids[key.stops[position]]);
+    }
+}
+
 vector<string> RouteLabel::to_stop_ids() const {
     // from a given routeLabel, this functions builds back the list of its stop's ids :
     vector<string> stops;
@@ -18,6 +37,52 @@ vector<string> RouteLabel::to_stop_ids() const {
     return stops;
 }
 
+void ParsedRoute::append(ParsedRoute&& other) {
+    assert(nb_stops == other.nb_stops && trip_ids == other.trip_ids);
+    trip_indexes.insert(trip_indexes.end(), other.trip_indexes.begin(), other.trip_indexes.end());
+    arrivals.insert(arrivals.end(), other.arrivals.begin(), other.arrivals.end());
+    departures.insert(departures.end(), other.departures.begin(), other.departures.end());
+    other = ParsedRoute{};
+}
+
+void ParsedRoute::sort_trips() {
+    vector<size_t> order(nb_trips());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [this](size_t left, size_t right) {
+        return orderable_trip_id(left) < orderable_trip_id(right);
+    });
+    if (is_sorted(order.begin(), order.end()))
+        return;
+
+    vector<TripIndex> sorted_trip_indexes;
+    vector<int> sorted_arrivals;
+    vector<int> sorted_departures;
+    sorted_trip_indexes.reserve(trip_indexes.size());
+    sorted_arrivals.reserve(arrivals.size());
+    sorted_departures.reserve(departures.size());
+    for (size_t trip : order) {
+        sorted_trip_indexes.push_back(trip_indexes[trip]);
+        sorted_arrivals.insert(sorted_arrivals.end(), arrivals.begin() + trip * nb_stops,
+                               arrivals.begin() + (trip + 1) * nb_stops);
+        sorted_departures.insert(sorted_departures.end(), departures.begin() + trip * nb_stops,
+                                 departures.begin() + (trip + 1) * nb_stops);
+    }
+    trip_indexes = move(sorted_trip_indexes);
+    arrivals = move(sorted_arrivals);
+    departures = move(sorted_departures);
+}
+
+bool ParsedRoute::operator==(ParsedRoute const& other) const {
+    if (nb_stops != other.nb_stops || arrivals != other.arrivals || departures != other.departures ||
+        nb_trips() != other.nb_trips())
+        return false;
+    for (size_t trip = 0; trip < nb_trips(); ++trip) {
+        if (trip_id(trip) != other.trip_id(trip))
+            return false;
+    }
+    return true;
+}
+
 // there is a slight rounding error in json serialization/deserialization of coordinates
 // to make this error unvisible (and allow that using deserialized data is binary iso), we limit
 // the double places after the comma.
@@ -1,21 +1,47 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
 #include <vector>
 #include <map>
+#include <memory>
+#include <string>
 
 // this module defines the structures used to store GTFS data after parsing.
 
 namespace uwpreprocess {
 
 // amongst the trips of a given route, we want to order trips by their departure time
-// to achieve that, we use a std::pair, as the pair will compare using its left element :
+// to achieve that, a trip is identified by a std::pair, as the pair will compare using its left element :
 using TripEventTime = int;  // departure/arrival times are represented in number of seconds
-using OrderableTripId = std::pair<TripEventTime, std::string>;
+using OrderableTripId = std::pair<TripEventTime, std::string const&>;
+
+// A TripIndex is the index of a trip in a table of interned trip ids (shared by all the routes) :
+using TripIndex = uint32_t;
+using TripIds = std::vector<std::string>;
+
+// A StopIndex is the index of a stop in a table of interned stop ids :
+using StopIndex = uint32_t;
+
+// A RouteKey identifies a (scientific) route by the sequence of its stops, as interned stop indexes :
+// partitioning the trips in routes only hashes and compares small integers (the hash is computed once).
+struct RouteKey {
+    explicit RouteKey(std::vector<StopIndex>&& stops_);
+    bool operator==(RouteKey const& other) const { return hash == other.hash && stops == other.stops; }
+    std::vector<StopIndex> stops;
+    size_t hash;
+};
+
+struct RouteKeyHasher {
+    size_t operator()(RouteKey const& key) const { return key.hash; }
+};
 
 // A RouteLabel is a wrapper around a string that stores the concatenation of the route's stop ids
+// (it is only built once per route, as the identifier of the route in the serialized data)
 struct RouteLabel {
     RouteLabel() = default;
     RouteLabel(std::string const& label_) : label{label_} {}
+    RouteLabel(RouteKey const& key, std::vector<std::string> const& stop_ids);  // stop_ids = the interned stop ids
     std::vector<std::string> to_stop_ids() const;
     operator std::string() const { return label; }
     bool operator<(std::string const& other) const { return label < other; }
@@ -23,14 +49,109 @@ struct RouteLabel {
     std::string label;
 };
 
-// A ParsedRoute stores the trips (and their events) of a route
+// A ParsedRoute stores the trips (and their events) of a route, as columns (structure of arrays) :
+//  - the trips are ordered by their OrderableTripId, i.e. by (departure time at the first stop, trip id)
+//  - trip_indexes[trip] is the index of the trip in the (shared) table of interned trip ids
+//  - the events are a trips × stops matrix (row-major) : the events of a trip at the stop of the given position are
+//    arrivals[trip * nb_stops + position] and departures[trip * nb_stops + position]
+// A trip is a contiguous row, and the departures at a given stop are a strided column, as RAPTOR-like scans expect.
 struct ParsedRoute {
-    using StopEvent = std::pair<int, int>;                            // arrival, departure
-    using Trips = std::map<OrderableTripId, std::vector<StopEvent>>;  // the map ensures trips are ordered
-    ParsedRoute(Trips&& trips_) : trips{trips_} {}
+    using StopEvent = std::pair<int, int>;  // arrival, departure
+
+    // the events of a trip (a row of the matrix), iterated as StopEvents :
+    class TripEvents {
+       public:
+        class iterator {
+           public:
+            iterator(int const* arrival_, int const* departure_) : arrival{arrival_}, departure{departure_} {}
+            StopEvent operator*() const { return {*arrival, *departure}; }
+            iterator& operator++() {
+                ++arrival;
+                ++departure;
+                return *this;
+            }
+            bool operator==(iterator const& other) const { return arrival == other.arrival; }
+            bool operator!=(iterator const& other) const { return arrival != other.arrival; }
+
+           private:
+            int const* arrival;
+            int const* departure;
+        };
+
+        TripEvents(int const* arrivals_, int const* departures_, size_t size_)
+            : arrivals{arrivals_}, departures{departures_}, nb_events{size_} {}
+        iterator begin() const { return {arrivals, departures}; }
+        iterator end() const { return {arrivals + nb_events, departures + nb_events}; }
+        size_t size() const { return nb_events; }
+        StopEvent operator[](size_t position) const { return {arrivals[position], departures[position]}; }
+
+       private:
+        int const* arrivals;
+        int const* departures;
+        size_t nb_events;
+    };
+
+    // the trips of the route, iterated (in order) as pairs {OrderableTripId, TripEvents} :
+    class Trips {
+       public:
+        class iterator {
+           public:
+            iterator(ParsedRoute const& route_, size_t trip_) : route{&route_}, trip{trip_} {}
+            std::pair<OrderableTripId, TripEvents> operator*() const {
+                return {route->orderable_trip_id(trip), route->trip_events(trip)};
+            }
+            iterator& operator++() {
+                ++trip;
+                return *this;
+            }
+            bool operator==(iterator const& other) const { return trip == other.trip; }
+            bool operator!=(iterator const& other) const { return trip != other.trip; }
+
+           private:
+            ParsedRoute const* route;
+            size_t trip;
+        };
+
+        explicit Trips(ParsedRoute const& route_) : route{route_} {}
+        iterator begin() const { return {route, 0}; }
+        iterator end() const { return {route, route.nb_trips()}; }
+        size_t size() const { return route.nb_trips(); }
+
+       private:
+        ParsedRoute const& route;
+    };
+
     ParsedRoute() = default;
-    bool operator==(ParsedRoute const& other) const { return trips == other.trips; }
-    Trips trips;
+    ParsedRoute(size_t nb_stops_, std::shared_ptr<TripIds const> trip_ids_)
+        : nb_stops{nb_stops_}, trip_ids{std::move(trip_ids_)} {}
+
+    // building : add_trip appends a trip, whose events are then appended with add_event (in the order of the stops)
+    inline void add_trip(TripIndex trip_index) { trip_indexes.push_back(trip_index); }
+    inline void add_event(int arrival, int departure) {
+        arrivals.push_back(arrival);
+        departures.push_back(departure);
+    }
+    void append(ParsedRoute&& other);  // appends the trips of another route (with the same stops and table of trip ids)
+    void sort_trips();                 // orders the trips by OrderableTripId
+
+    // accessing :
+    inline size_t nb_trips() const { return trip_indexes.size(); }
+    inline Trips trips() const { return Trips{*this}; }
+    inline std::string const& trip_id(size_t trip) const { return (*trip_ids)[trip_indexes[trip]]; }
+    inline OrderableTripId orderable_trip_id(size_t trip) const { return {departures[trip * nb_stops], trip_id(trip)}; }
+    inline TripEvents trip_events(size_t trip) const {
+        assert(arrivals.size() == nb_trips() * nb_stops);
+        return {arrivals.data() + trip * nb_stops, departures.data() + trip * nb_stops, nb_stops};
+    }
+
+    // (the trip ids are compared, not their indexes in the table)
+    bool operator==(ParsedRoute const& other) const;
+
+    size_t nb_stops = 0;
+    std::vector<TripIndex> trip_indexes;
+    std::vector<int> arrivals;
+    std::vector<int> departures;
+    std::shared_ptr<TripIds const> trip_ids;
 };
 
 // A ParsedStop stores what is necessary to ultra : name and coordinates.
@@ -0,0 +1,425 @@
+#include "gtfs_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std;
+
+namespace uwpreprocess {
+
+static string_view _trim(string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+static runtime_error _parsing_error(CsvFile const& file, string const& message) {
+    ostringstream oss;
+    oss << "ERROR : " << message << " (" << file.path() << ", line " << file.line() << ")";
+    return runtime_error(oss.str());
+}
+
+CsvFile::CsvFile(string const& path) : file_path{path} {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("ERROR : unable to open file : " + path);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("ERROR : unable to stat file : " + path);
+    }
+    length = static_cast<size_t>(file_stat.st_size);
+    if (length > 0) {
+        address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            address = nullptr;
+            close(fd);
+            throw runtime_error("ERROR : unable to mmap file : " + path);
+        }
+        madvise(address, length, MADV_SEQUENTIAL);
+    }
+    close(fd);  // the mapping stays valid after the file is closed
+
+    cursor = static_cast<char const*>(address);
+    end = cursor + length;
+    if (length >= 3 && memcmp(cursor, "\xEF\xBB\xBF", 3) == 0)
+        cursor += 3;  // UTF-8 BOM
+    if (!next_row(header))
+        throw runtime_error("ERROR : missing header in file : " + path);
+    for (auto& column_name : header) {
+        column_name = _trim(column_name);
+    }
+    first_row = cursor;
+    first_row_line = current_line;
+}
+
+CsvFile::~CsvFile() {
+    if (address != nullptr)
+        munmap(address, length);
+}
+
+size_t CsvFile::column(string_view name) const {
+    auto found = find(header.begin(), header.end(), name);
+    return found == header.end() ? NO_COLUMN : static_cast<size_t>(found - header.begin());
+}
+
+size_t CsvFile::required_column(string_view name) const {
+    size_t index = column(name);
+    if (index == NO_COLUMN)
+        throw runtime_error("ERROR : missing column '" + string(name) + "' in file : " + file_path);
+    return index;
+}
+
+void CsvFile::rewind() {
+    cursor = first_row;
+    current_line = first_row_line;
+    row_line = 0;
+}
+
+string_view CsvFile::next_field() {
+    if (cursor == end || *cursor != '"') {
+        char const* start = cursor;
+        while (cursor != end && *cursor != ',' && *cursor != '\n' && *cursor != '\r') {
+            ++cursor;
+        }
+        return {start, static_cast<size_t>(cursor - start)};
+    }
+
+    // quoted field (it may contain delimiters, newlines, and escaped quotes) :
+    char const* start = ++cursor;
+    bool has_escaped_quotes = false;
+    char const* closing_quote;
+    while (true) {
+        closing_quote = static_cast<char const*>(memchr(cursor, '"', static_cast<size_t>(end - cursor)));
+        if (closing_quote == nullptr)
+            throw _parsing_error(*this, "unterminated quoted field");
+        if (closing_quote + 1 != end && closing_quote[1] == '"') {
+            has_escaped_quotes = true;
+            cursor = closing_quote + 2;
+            continue;
+        }
+        break;
+    }
+    current_line += static_cast<size_t>(count(start, closing_quote, '\n'));
+    cursor = closing_quote + 1;
+    while (cursor != end && *cursor != ',' && *cursor != '\n' && *cursor != '\r') {
+        ++cursor;  // (lenient : what follows the closing quote is ignored)
+    }
+
+    string_view field{start, static_cast<size_t>(closing_quote - start)};
+    if (!has_escaped_quotes)
+        return field;
+    string& unescaped = unescaped_fields.emplace_back();
+    unescaped.reserve(field.size());
+    for (size_t index = 0; index < field.size(); ++index) {
+        unescaped.push_back(field[index]);
+        if (field[index] == '"')
+            ++index;  // the second quote of the escaped pair
+    }
+    return unescaped;
+}
+
+bool CsvFile::next_row(vector<string_view>& fields) {
+    fields.clear();
+    while (cursor != end && (*cursor == '\n' || *cursor == '\r')) {
+        if (*cursor == '\n')
+            ++current_line;
+        ++cursor;
+    }
+    if (cursor == end)
+        return false;
+
+    row_line = current_line;
+    while (true) {
+        fields.push_back(next_field());
+        if (cursor == end)
+            return true;
+        if (*cursor == ',') {
+            ++cursor;
+            continue;
+        }
+        if (*cursor == '\r')
+            ++cursor;
+        if (cursor != end && *cursor == '\n') {
+            ++cursor;
+            ++current_line;
+        }
+        return true;
+    }
+}
+
+template <typename Number>
+static bool _parse_number(string_view text, Number& number) {
+    text = _trim(text);
+    auto [last, error] = from_chars(text.data(), text.data() + text.size(), number);
+    return error == errc{} && last == text.data() + text.size() && !text.empty();
+}
+
+int parse_gtfs_time(string_view text) {
+    // H:MM:SS or HH:MM:SS (or more digits, the hours may exceed 24) :
+    text = _trim(text);
+    size_t first_colon = text.find(':');
+    size_t second_colon = first_colon == string_view::npos ? first_colon : text.find(':', first_colon + 1);
+    int hours, minutes, seconds;
+    if (second_colon == string_view::npos || !_parse_number(text.substr(0, first_colon), hours) ||
+        !_parse_number(text.substr(first_colon + 1, second_colon - first_colon - 1), minutes) ||
+        !_parse_number(text.substr(second_colon + 1), seconds) || hours < 0 || minutes < 0 || minutes > 59 ||
+        seconds < 0 || seconds > 59)
+        throw runtime_error("ERROR : invalid GTFS time : '" + string(text) + "'");
+    return hours * 3600 + minutes * 60 + seconds;
+}
+
+static double _parse_coordinate(CsvFile const& file, string_view text) {
+    // (the coordinates are optional for some location types, e.g. generic nodes)
+    if (_trim(text).empty())
+        return numeric_limits<double>::quiet_NaN();
+    double coordinate;
+    if (!_parse_number(text, coordinate))
+        throw _parsing_error(file, "invalid coordinate : '" + string(text) + "'");
+    return coordinate;
+}
+
+GtfsReader::GtfsReader(string const& gtfs_folder)
+    : folder{gtfs_folder}, stops_file{gtfs_folder + "/stops.txt"}, trips_file{gtfs_folder + "/trips.txt"} {
+    vector<string_view> fields;
+
+    size_t stop_id_column = stops_file.required_column("stop_id");
+    size_t stop_name_column = stops_file.column("stop_name");
+    size_t stop_lat_column = stops_file.required_column("stop_lat");
+    size_t stop_lon_column = stops_file.required_column("stop_lon");
+    unordered_set<string_view> stop_ids;
+    while (stops_file.next_row(fields)) {
+        GtfsStop stop;
+        stop.id = CsvFile::field(fields, stop_id_column);
+        stop.name = CsvFile::field(fields, stop_name_column);
+        stop.latitude = _parse_coordinate(stops_file, CsvFile::field(fields, stop_lat_column));
+        stop.longitude = _parse_coordinate(stops_file, CsvFile::field(fields, stop_lon_column));
+        if (!stop_ids.insert(stop.id).second)
+            throw _parsing_error(stops_file, "duplicated stop id '" + string(stop.id) + "'");
+        all_stops.push_back(stop);
+    }
+
+    size_t trip_id_column = trips_file.required_column("trip_id");
+    size_t service_id_column = trips_file.required_column("service_id");
+    while (trips_file.next_row(fields)) {
+        string_view trip_id = CsvFile::field(fields, trip_id_column);
+        if (!trip_indexes.insert({trip_id, static_cast<uint32_t>(all_trip_ids.size())}).second)
+            throw _parsing_error(trips_file, "duplicated trip id '" + string(trip_id) + "'");
+        all_trip_ids.push_back(trip_id);
+        string_view service_id = CsvFile::field(fields, service_id_column);
+        all_trip_services.push_back(
+            service_indexes.insert({service_id, static_cast<uint32_t>(service_indexes.size())}).first->second);
+    }
+}
+
+static bool _file_exists(string const& path) {
+    struct stat file_stat;
+    return stat(path.c_str(), &file_stat) == 0;
+}
+
+static GtfsDay _parse_date_field(CsvFile const& file, string_view text) {
+    try {
+        return parse_gtfs_date(_trim(text));
+    } catch (runtime_error const& error) {
+        throw _parsing_error(file, error.what());
+    }
+}
+
+vector<vector<GtfsDay>> GtfsReader::services_active_days(ServiceWindow const& window) const {
+    // the activity of each service on each day of the window (the services not used by any trip are ignored) :
+    vector<vector<char>> is_service_active(service_indexes.size(), vector<char>(window.nb_days(), false));
+    vector<string_view> fields;
+
+    string const calendar_path = folder + "/calendar.txt";
+    string const calendar_dates_path = folder + "/calendar_dates.txt";
+    bool has_calendar = _file_exists(calendar_path);
+    bool has_calendar_dates = _file_exists(calendar_dates_path);
+    if (!has_calendar && !has_calendar_dates)
+        throw runtime_error("ERROR : the feed has neither calendar.txt nor calendar_dates.txt : " + folder);
+
+    // the weekly services :
+    if (has_calendar) {
+        CsvFile calendar{calendar_path};
+        size_t service_id_column = calendar.required_column("service_id");
+        size_t weekday_columns[7] = {
+            calendar.required_column("monday"),   calendar.required_column("tuesday"),
+            calendar.required_column("wednesday"), calendar.required_column("thursday"),
+            calendar.required_column("friday"),   calendar.required_column("saturday"),
+            calendar.required_column("sunday"),
+        };
+        size_t start_date_column = calendar.required_column("start_date");
+        size_t end_date_column = calendar.required_column("end_date");
+        while (calendar.next_row(fields)) {
+            auto service = service_indexes.find(CsvFile::field(fields, service_id_column));
+            if (service == service_indexes.end())
+                continue;
+            GtfsDay start_day = _parse_date_field(calendar, CsvFile::field(fields, start_date_column));
+            GtfsDay end_day = _parse_date_field(calendar, CsvFile::field(fields, end_date_column));
+            bool is_weekday_active[7];
+            for (int day = 0; day < 7; ++day) {
+                is_weekday_active[day] = _trim(CsvFile::field(fields, weekday_columns[day])) == "1";
+            }
+            for (GtfsDay day = max(start_day, window.first_day); day <= min(end_day, window.last_day); ++day) {
+                if (is_weekday_active[weekday(day)])
+                    is_service_active[service->second][static_cast<size_t>(day - window.first_day)] = true;
+            }
+        }
+    }
+
+    // the exceptions (a service may also be defined by its exceptions only) :
+    if (has_calendar_dates) {
+        CsvFile calendar_dates{calendar_dates_path};
+        size_t service_id_column = calendar_dates.required_column("service_id");
+        size_t date_column = calendar_dates.required_column("date");
+        size_t exception_type_column = calendar_dates.required_column("exception_type");
+        while (calendar_dates.next_row(fields)) {
+            auto service = service_indexes.find(CsvFile::field(fields, service_id_column));
+            if (service == service_indexes.end())
+                continue;
+            GtfsDay day = _parse_date_field(calendar_dates, CsvFile::field(fields, date_column));
+            if (day < window.first_day || day > window.last_day)
+                continue;
+            string_view exception_type = _trim(CsvFile::field(fields, exception_type_column));
+            if (exception_type != "1" && exception_type != "2")
+                throw _parsing_error(calendar_dates, "invalid exception_type '" + string(exception_type) + "'");
+            is_service_active[service->second][static_cast<size_t>(day - window.first_day)] = exception_type == "1";
+        }
+    }
+
+    vector<vector<GtfsDay>> active_days(service_indexes.size());
+    for (size_t service = 0; service < service_indexes.size(); ++service) {
+        for (size_t day = 0; day < window.nb_days(); ++day) {
+            if (is_service_active[service][day])
+                active_days[service].push_back(window.first_day + static_cast<GtfsDay>(day));
+        }
+    }
+    return active_days;
+}
+
+namespace {
+struct _StopTimesColumns {
+    explicit _StopTimesColumns(CsvFile const& file)
+        : trip_id{file.required_column("trip_id")},
+          arrival_time{file.required_column("arrival_time")},
+          departure_time{file.required_column("departure_time")},
+          stop_id{file.required_column("stop_id")},
+          stop_sequence{file.required_column("stop_sequence")} {}
+    size_t trip_id;
+    size_t arrival_time;
+    size_t departure_time;
+    size_t stop_id;
+    size_t stop_sequence;
+};
+}  // namespace
+
+static GtfsStopTime _parse_stop_time(CsvFile const& file,
+                                     _StopTimesColumns const& columns,
+                                     vector<string_view> const& fields) {
+    // (the times are optional for the stops that are not timepoints : a missing time is the other one)
+    string_view arrival = _trim(CsvFile::field(fields, columns.arrival_time));
+    string_view departure = _trim(CsvFile::field(fields, columns.departure_time));
+    if (arrival.empty() && departure.empty())
+        throw _parsing_error(file, "stop_time without arrival and departure times (interpolation is unsupported)");
+
+    GtfsStopTime stoptime;
+    stoptime.stop_id = CsvFile::field(fields, columns.stop_id);
+    try {
+        stoptime.arrival_time = parse_gtfs_time(arrival.empty() ? departure : arrival);
+        stoptime.departure_time = parse_gtfs_time(departure.empty() ? arrival : departure);
+    } catch (runtime_error const& error) {
+        throw _parsing_error(file, error.what());
+    }
+    string_view stop_sequence = CsvFile::field(fields, columns.stop_sequence);
+    if (!_parse_number(stop_sequence, stoptime.stop_sequence))
+        throw _parsing_error(file, "invalid stop_sequence '" + string(stop_sequence) + "'");
+    return stoptime;
+}
+
+void GtfsReader::for_each_trips_batch(size_t batch_size,
+                                      TripsConsumer const& consume,
+                                      RestartHandler const& restart) const {
+    CsvFile stop_times_file{folder + "/stop_times.txt"};
+    _StopTimesColumns columns{stop_times_file};
+
+    vector<GtfsTripStopTimes> batch;
+    batch.reserve(batch_size);
+    bool is_a_batch_consumed = false;
+    auto flush_batch = [&batch, &consume, &is_a_batch_consumed]() {
+        auto by_sequence = [](auto const& left, auto const& right) { return left.stop_sequence < right.stop_sequence; };
+        for (auto& trip : batch) {
+            if (!is_sorted(trip.stoptimes.begin(), trip.stoptimes.end(), by_sequence))
+                stable_sort(trip.stoptimes.begin(), trip.stoptimes.end(), by_sequence);
+        }
+        consume(batch);
+        batch.clear();
+        is_a_batch_consumed = true;
+    };
+
+    // adds the stop_time to its trip, returns false if it begins a trip whose rows were already read (i.e. the rows
+    // of this trip are not contiguous) :
+    vector<bool> is_trip_read(all_trip_ids.size(), false);
+    auto add_stop_time = [&](string_view trip_id, GtfsStopTime const& stoptime) {
+        if (batch.empty() || batch.back().trip_id != trip_id) {
+            auto trip_index = trip_indexes.find(trip_id);
+            if (trip_index == trip_indexes.end())
+                throw _parsing_error(stop_times_file, "unknown trip id '" + string(trip_id) + "'");
+            if (is_trip_read[trip_index->second])
+                return false;
+            is_trip_read[trip_index->second] = true;
+
+            // the previous trip is complete :
+            if (batch.size() == batch_size)
+                flush_batch();
+            batch.push_back({trip_id, trip_index->second, {}});
+        }
+        batch.back().stoptimes.push_back(stoptime);
+        return true;
+    };
+
+    // the rows are streamed, as long as the rows of each trip are contiguous :
+    vector<string_view> fields;
+    bool are_rows_grouped = true;
+    while (are_rows_grouped && stop_times_file.next_row(fields)) {
+        are_rows_grouped = add_stop_time(CsvFile::field(fields, columns.trip_id),
+                                         _parse_stop_time(stop_times_file, columns, fields));
+    }
+
+    if (!are_rows_grouped) {
+        // the rows of some trips are scattered in the file : the trips handed so far are discarded, then all the rows
+        // are read again, and (stable) sorted by trip :
+        if (is_a_batch_consumed)
+            restart();
+        batch.clear();
+        is_trip_read.assign(is_trip_read.size(), false);
+        stop_times_file.rewind();
+        vector<pair<string_view, GtfsStopTime>> rows;
+        while (stop_times_file.next_row(fields)) {
+            rows.emplace_back(CsvFile::field(fields, columns.trip_id),
+                              _parse_stop_time(stop_times_file, columns, fields));
+        }
+        stable_sort(rows.begin(), rows.end(),
+                    [](auto const& left, auto const& right) { return left.first < right.first; });
+        for (auto const& [trip_id, stoptime] : rows) {
+            add_stop_time(trip_id, stoptime);
+        }
+    }
+    if (!batch.empty())
+        flush_batch();
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "service_calendar.h"
+
+// this module reads the few GTFS tables needed to build the routes (stops.txt, trips.txt and stop_times.txt, and the
+// calendars if the trips are restricted to some days), without materializing the whole feed : the files are
+// memory-mapped, and the fields are string_views into the mapping.
+
+namespace uwpreprocess {
+
+// A memory-mapped CSV file (RFC 4180, as used by GTFS), tokenized without any allocation per field :
+// the fields are views into the mapping, except the quoted fields with escaped quotes, that have to be unescaped
+// (they are copied in a storage that lives as long as the file, which is acceptable, as they are rare).
+class CsvFile {
+   public:
+    explicit CsvFile(std::string const& path);
+    ~CsvFile();
+    CsvFile(CsvFile const&) = delete;
+    CsvFile& operator=(CsvFile const&) = delete;
+
+    static constexpr const size_t NO_COLUMN = SIZE_MAX;
+    size_t column(std::string_view name) const;           // NO_COLUMN if the header has no such column
+    size_t required_column(std::string_view name) const;  // throws if the header has no such column
+
+    // reads the next row (empty lines are skipped), returns false at the end of the file :
+    bool next_row(std::vector<std::string_view>& fields);
+    void rewind();  // the next row is the first one after the header
+
+    // (a missing trailing field, or a missing column, is an empty field)
+    static inline std::string_view field(std::vector<std::string_view> const& fields, size_t column) {
+        return column < fields.size() ? fields[column] : std::string_view{};
+    }
+
+    std::string const& path() const { return file_path; }
+    size_t line() const { return row_line; }  // line of the last row read (for error messages)
+
+   private:
+    std::string_view next_field();
+
+    std::string file_path;
+    void* address = nullptr;
+    size_t length = 0;
+    char const* first_row = nullptr;
+    char const* cursor = nullptr;
+    char const* end = nullptr;
+    size_t first_row_line = 0;
+    size_t current_line = 1;
+    size_t row_line = 0;
+    std::vector<std::string_view> header;
+    std::deque<std::string> unescaped_fields;
+};
+
+// "HH:MM:SS" to a number of seconds (hours may exceed 24, for the trips that end after midnight) :
+int parse_gtfs_time(std::string_view text);
+
+struct GtfsStopTime {
+    std::string_view stop_id;
+    int arrival_time;
+    int departure_time;
+    uint32_t stop_sequence;
+};
+
+// the stop_times of a trip, ordered by stop_sequence :
+struct GtfsTripStopTimes {
+    std::string_view trip_id;
+    uint32_t trip_index;  // index of the trip in trips.txt
+    std::vector<GtfsStopTime> stoptimes;
+};
+
+struct GtfsStop {
+    std::string_view id;
+    std::string_view name;
+    double latitude;
+    double longitude;
+};
+
+// GtfsReader reads stops.txt and trips.txt when it is built (they are small), and streams stop_times.txt (which is
+// by far the largest file of a feed) : the rows of each trip are grouped, and handed to a consumer by batches of trips.
+// The views of the stops stay valid as long as the reader.
+class GtfsReader {
+   public:
+    explicit GtfsReader(std::string const& gtfs_folder);
+
+    std::vector<GtfsStop> const& stops() const { return all_stops; }
+    std::vector<std::string_view> const& trip_ids() const { return all_trip_ids; }  // (in the order of trips.txt)
+    std::vector<uint32_t> const& trip_services() const { return all_trip_services; }  // (interned service of a trip)
+
+    // reads calendar.txt and calendar_dates.txt (at least one of them must exist) : for each service used by the trips,
+    // returns the (ordered) days of the window on which it is active.
+    std::vector<std::vector<GtfsDay>> services_active_days(ServiceWindow const& window) const;
+
+    // The rows of stop_times.txt are streamed : in practice, the rows of a trip are contiguous, and a trip is handed
+    // to the consumer as soon as its rows are read (the file is read once). If they are not (the GTFS reference doesn't
+    // require it), this is detected when the rows of a trip appear again after the ones of another trip : the trips
+    // already handed must then be discarded by the consumer (restart is called, if some were handed), and the file is
+    // read again, its rows being sorted by trip before being handed (which materializes them).
+    // The trips in a batch (and their views) are only valid during the call to the consumer.
+    // Throws if a trip is not in trips.txt. The trips of trips.txt without stop_times are ignored.
+    using TripsConsumer = std::function<void(std::vector<GtfsTripStopTimes>& trips_batch)>;
+    using RestartHandler = std::function<void()>;
+    void for_each_trips_batch(size_t batch_size, TripsConsumer const& consume, RestartHandler const& restart) const;
+
+   private:
+    std::string folder;
+    CsvFile stops_file;
+    CsvFile trips_file;
+    std::vector<GtfsStop> all_stops;
+    std::vector<std::string_view> all_trip_ids;
+    std::unordered_map<std::string_view, uint32_t> trip_indexes;
+    std::vector<uint32_t> all_trip_services;
+    std::unordered_map<std::string_view, uint32_t> service_indexes;
+};
+
+}  // namespace uwpreprocess
@@ -0,0 +1,85 @@
+#include "service_calendar.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+using namespace std;
+
+namespace uwpreprocess {
+
+// conversions between a civil date and a number of days since 1970-01-01 (proleptic gregorian calendar) :
+// see http://howardhinnant.github.io/date_algorithms.html
+static GtfsDay _days_from_civil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int const era = (year >= 0 ? year : year - 399) / 400;
+    unsigned const year_of_era = static_cast<unsigned>(year - era * 400);
+    unsigned const day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned const day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<int>(day_of_era) - 719468;
+}
+
+static void _civil_from_days(GtfsDay days, int& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    int const era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned const day_of_era = static_cast<unsigned>(days - era * 146097);
+    unsigned const year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    unsigned const day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    unsigned const shifted_month = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    year = static_cast<int>(year_of_era) + era * 400 + (month <= 2);
+}
+
+GtfsDay parse_gtfs_date(string_view text) {
+    auto invalid_date = [&text]() { return runtime_error("ERROR : invalid GTFS date : '" + string(text) + "'"); };
+    if (text.size() != 8)
+        throw invalid_date();
+    int digits[8];
+    for (size_t index = 0; index < 8; ++index) {
+        if (text[index] < '0' || text[index] > '9')
+            throw invalid_date();
+        digits[index] = text[index] - '0';
+    }
+    int year = digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3];
+    unsigned month = static_cast<unsigned>(digits[4] * 10 + digits[5]);
+    unsigned day = static_cast<unsigned>(digits[6] * 10 + digits[7]);
+    GtfsDay days = _days_from_civil(year, month, day);
+
+    // (rejects the dates that don't exist, e.g. 20230230) :
+    int checked_year;
+    unsigned checked_month, checked_day;
+    _civil_from_days(days, checked_year, checked_month, checked_day);
+    if (month < 1 || month > 12 || checked_year != year || checked_month != month || checked_day != day)
+        throw invalid_date();
+    return days;
+}
+
+string format_gtfs_date(GtfsDay day) {
+    int year;
+    unsigned month, day_of_month;
+    _civil_from_days(day, year, month, day_of_month);
+    char text[16];
+    snprintf(text, sizeof(text), "%04d%02u%02u", year, month, day_of_month);
+    return text;
+}
+
+int weekday(GtfsDay day) {
+    // 1970-01-01 was a thursday :
+    return ((day % 7) + 7 + 3) % 7;
+}
+
+string ServiceWindow::as_string() const {
+    return format_gtfs_date(first_day) + ":" + format_gtfs_date(last_day) + (unroll_days ? " (unrolled)" : "");
+}
+
+ServiceWindow parse_service_window(string_view text) {
+    size_t separator = text.find(':');
+    ServiceWindow window;
+    window.first_day = parse_gtfs_date(text.substr(0, separator));
+    window.last_day = separator == string_view::npos ? window.first_day : parse_gtfs_date(text.substr(separator + 1));
+    if (window.last_day < window.first_day)
+        throw runtime_error("ERROR : the service window ends before it begins : '" + string(text) + "'");
+    return window;
+}
+
+}  // namespace uwpreprocess
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// this module defines the days used to restrict the trips to the ones whose service is active during a window of days.
+
+namespace uwpreprocess {
+
+// A day is represented by its number of days since 1970-01-01 (thus, the day after a day is the next integer) :
+using GtfsDay = int32_t;
+
+GtfsDay parse_gtfs_date(std::string_view text);  // "YYYYMMDD" (the format of the GTFS dates)
+std::string format_gtfs_date(GtfsDay day);       // "YYYYMMDD"
+int weekday(GtfsDay day);                         // 0 = monday, ..., 6 = sunday
+
+// A window of days (both included) : only the trips whose service is active on at least a day of the window are kept.
+// If the days are unrolled, a trip is duplicated once per day of the window on which its service is active :
+//  - the copy of the trip of a given day has the id "<trip_id>@<YYYYMMDD>"
+//  - its times are shifted by the number of days since the first day of the window (thus, they are relative to the
+//    first day of the window, and not to the day of the trip anymore)
+// The trips of the day before the window that are still running after midnight (stop times >= 24:00) are also kept
+// (their copy is the one of the day before, and their times are shifted by -24 hours).
+// NOTE : the days are assumed to last 24 hours (the daylight saving time changes are ignored).
+struct ServiceWindow {
+    GtfsDay first_day;
+    GtfsDay last_day;
+    bool unroll_days = false;
+
+    inline size_t nb_days() const { return static_cast<size_t>(last_day - first_day + 1); }
+    std::string as_string() const;
+};
+
+// "YYYYMMDD" (a single day) or "YYYYMMDD:YYYYMMDD" (throws if the window is ill-formed or empty) :
+ServiceWindow parse_service_window(std::string_view text);
+
+}  // namespace uwpreprocess
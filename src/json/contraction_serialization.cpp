@@ -0,0 +1,95 @@
+#include "contraction_serialization.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace uwpreprocess::json {
+
+void serialize_contraction_hierarchy_binary(ContractionHierarchy const& hierarchy, ostream& out) {
+    uint64_t nb_nodes = hierarchy.levels.size();
+    out.write(reinterpret_cast<char const*>(&nb_nodes), sizeof(nb_nodes));
+    out.write(reinterpret_cast<char const*>(hierarchy.levels.data()), nb_nodes * sizeof(uint32_t));
+
+    uint64_t nb_shortcuts = hierarchy.shortcuts.size();
+    out.write(reinterpret_cast<char const*>(&nb_shortcuts), sizeof(nb_shortcuts));
+    for (auto const& shortcut : hierarchy.shortcuts) {
+        out.write(reinterpret_cast<char const*>(&shortcut.from), sizeof(shortcut.from));
+        out.write(reinterpret_cast<char const*>(&shortcut.to), sizeof(shortcut.to));
+        out.write(reinterpret_cast<char const*>(&shortcut.weight), sizeof(shortcut.weight));
+        out.write(reinterpret_cast<char const*>(&shortcut.via), sizeof(shortcut.via));
+    }
+}
+
+ContractionHierarchy unserialize_contraction_hierarchy_binary(istream& in) {
+    ContractionHierarchy hierarchy;
+
+    uint64_t nb_nodes = 0;
+    in.read(reinterpret_cast<char*>(&nb_nodes), sizeof(nb_nodes));
+    hierarchy.levels.resize(nb_nodes);
+    in.read(reinterpret_cast<char*>(hierarchy.levels.data()), nb_nodes * sizeof(uint32_t));
+
+    uint64_t nb_shortcuts = 0;
+    in.read(reinterpret_cast<char*>(&nb_shortcuts), sizeof(nb_shortcuts));
+    hierarchy.shortcuts.resize(nb_shortcuts);
+    for (auto& shortcut : hierarchy.shortcuts) {
+        in.read(reinterpret_cast<char*>(&shortcut.from), sizeof(shortcut.from));
+        in.read(reinterpret_cast<char*>(&shortcut.to), sizeof(shortcut.to));
+        in.read(reinterpret_cast<char*>(&shortcut.weight), sizeof(shortcut.weight));
+        in.read(reinterpret_cast<char*>(&shortcut.via), sizeof(shortcut.via));
+    }
+    if (!in)
+        throw runtime_error("ERROR : truncated contraction hierarchy file");
+    return hierarchy;
+}
+
+void serialize_contraction_hierarchy_hluw(ContractionHierarchy const& hierarchy,
+                                          WalkingGraph const& graph,
+                                          string const& hluw_output_dir) {
+    // the node of each rank is retrieved from the edges (each ranked node has at least one out-edge) :
+    vector<NodeId> node_of_rank(hierarchy.levels.size());
+    for (auto& edge : graph.edges_with_stops_bidirectional) {
+        node_of_rank.at(edge.node_from.get_rank()) = edge.node_from.id;
+    }
+
+    ofstream out_levels(hluw_output_dir + "ch.levels");
+    for (size_t rank = 0; rank < hierarchy.levels.size(); ++rank) {
+        out_levels << graph.node_names.id(node_of_rank[rank]) << " ";
+        if (hierarchy.levels[rank] == ContractionHierarchy::UNCONTRACTED) {
+            out_levels << "-1\n";
+        } else {
+            out_levels << hierarchy.levels[rank] << "\n";
+        }
+    }
+
+    ofstream out_shortcuts(hluw_output_dir + "ch.shortcuts");
+    out_shortcuts << fixed << setprecision(0);  // displays integer weight (as in graph.edgefile)
+    for (auto& shortcut : hierarchy.shortcuts) {
+        out_shortcuts << graph.node_names.id(node_of_rank[shortcut.from]) << " ";
+        out_shortcuts << graph.node_names.id(node_of_rank[shortcut.to]) << " ";
+        out_shortcuts << shortcut.weight << " ";
+        out_shortcuts << graph.node_names.id(node_of_rank[shortcut.via]) << "\n";
+    }
+}
+
+bool _check_serialization_idempotent(ContractionHierarchy const& hierarchy) {
+    ostringstream oss;
+    serialize_contraction_hierarchy_binary(hierarchy, oss);
+
+    istringstream iss(oss.str());
+    ContractionHierarchy deserialized = unserialize_contraction_hierarchy_binary(iss);
+
+    auto are_shortcuts_equal = [](ContractionHierarchy::Shortcut const& left,
+                                  ContractionHierarchy::Shortcut const& right) {
+        return left.from == right.from && left.to == right.to && left.weight == right.weight && left.via == right.via;
+    };
+    return hierarchy.levels == deserialized.levels &&
+           equal(hierarchy.shortcuts.begin(), hierarchy.shortcuts.end(), deserialized.shortcuts.begin(),
+                 deserialized.shortcuts.end(), are_shortcuts_equal);
+}
+
+}  // namespace uwpreprocess::json
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "graph/contraction.h"
+#include "graph/walking_graph.h"
+
+namespace uwpreprocess::json {
+
+// binary format (host endianness), the nodes being identified by their rank in the walking graph :
+//      the number of nodes (uint64), then the level of each node (uint32, UNCONTRACTED for the kept stops)
+//      the number of shortcuts (uint64), then for each shortcut : from (uint32) + to (uint32) + weight (float32) + via
+//      (uint32)
+void serialize_contraction_hierarchy_binary(ContractionHierarchy const& hierarchy, std::ostream& out);
+ContractionHierarchy unserialize_contraction_hierarchy_binary(std::istream& in);
+
+// HL-UW format (same conventions as graph.edgefile, the nodes being identified by their id) :
+//      ch.levels    : one "<node_id> <level>" line per node (the level of a kept stop is -1)
+//      ch.shortcuts : one "<from_id> <to_id> <weight> <via_id>" line per shortcut
+void serialize_contraction_hierarchy_hluw(ContractionHierarchy const& hierarchy,
+                                          WalkingGraph const& graph,
+                                          std::string const& hluw_output_dir);
+
+bool _check_serialization_idempotent(ContractionHierarchy const&);
+
+}  // namespace uwpreprocess::json
@@ -1,6 +1,7 @@
 #include "gtfs_serialization.h"
 
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <rapidjson/document.h>
 #include <rapidjson/prettywriter.h>
@@ -36,7 +37,7 @@ void serialize_gtfs(GtfsParsedData const& gtfs_data, ostream& out) {
 
     // routes
     // routes are stored in a map that associates a label (key) to trips (value)
-    // trips are themselves a map that associates an OrderableTripId to a vector of events
+    // trips are themselves iterated as an ordered sequence of pairs {OrderableTripId, events}
     //
     // Détaillons un chouïa la map des trips :
     // Comme la map est ordonnée, il faut que je stocke une liste de pair{KEY|VALUE}.
@@ -45,7 +46,7 @@ void serialize_gtfs(GtfsParsedData const& gtfs_data, ostream& out) {
     rapidjson::Value routes_json(rapidjson::kArrayType);
     for (auto& [route_label, route] : gtfs_data.routes) {
         rapidjson::Value trips_json(rapidjson::kArrayType);
-        for (auto& [tripid, trip_events] : route.trips) {
+        for (auto const& [tripid, trip_events] : route.trips()) {
             // map-key = OrderableTripId = pair<TripEventTime, string>  (avec TripEventTime=int)
             rapidjson::Value orderable_trip_id_json(rapidjson::kArrayType);
             auto& [trip_event_time, id] = tripid;
@@ -54,7 +55,7 @@ void serialize_gtfs(GtfsParsedData const& gtfs_data, ostream& out) {
 
             // map-value = vector d'events = vector de pair<int, int> :
             rapidjson::Value events_json(rapidjson::kArrayType);
-            for (auto& [departure, arrival] : trip_events) {
+            for (auto const& [departure, arrival] : trip_events) {
                 rapidjson::Value event_pair_json(rapidjson::kArrayType);
                 event_pair_json.PushBack(departure, a);
                 event_pair_json.PushBack(arrival, a);
@@ -142,6 +143,7 @@ GtfsParsedData unserialize_gtfs(istream& in) {
     auto& routes_json = doc["routes"];
     assert_json_format(routes_json.IsArray(), "routes is not an array");
     map<RouteLabel, ParsedRoute> routes;
+    auto trip_ids = make_shared<TripIds>();  // (the trip ids are interned in their order of appearance)
     for (auto ite = routes_json.Begin(); ite != routes_json.End(); ++ite) {
         assert_json_format(ite->IsArray(), "routepair-iterator is not an array");
         assert_json_format(ite->Size() == 2, "routepair should have 2 elements");
@@ -155,7 +157,7 @@ GtfsParsedData unserialize_gtfs(istream& in) {
         auto& trips_json = (*ite)[1];
         assert_json_format(trips_json.IsArray(), "trips is not an array");
 
-        ParsedRoute::Trips trips;
+        ParsedRoute route;
         for (auto ite_bis = trips_json.Begin(); ite_bis != trips_json.End(); ++ite_bis) {
             assert_json_format(ite_bis->IsArray(), "trippair-iterator is not an array");
             assert_json_format(ite_bis->Size() == 2, "trippair should have 2 elements");
@@ -165,20 +167,22 @@ GtfsParsedData unserialize_gtfs(istream& in) {
             assert_json_format(orderable_trip_id_json.IsArray(), "orderabletripid is not an array");
             assert_json_format(orderable_trip_id_json.Size() == 2, "orderabletripid should have 2 elements");
 
+            // (the trip_event_time is the departure time at the first stop, thus it is not stored in the route)
             auto& trip_event_time_json = orderable_trip_id_json[0];
             assert_json_format(trip_event_time_json.IsInt(), "trip_event_time should be an int");
-            int trip_event_time = trip_event_time_json.GetInt();
 
             auto& trip_id_json = orderable_trip_id_json[1];
             assert_json_format(trip_id_json.IsString(), "trip_id should be a string");
-            string trip_id = trip_id_json.GetString();
-
-            OrderableTripId otid{trip_event_time, trip_id};
+            trip_ids->emplace_back(trip_id_json.GetString());
 
             // right-element of the trip-pair = value of the submap = the vector of stop_events
             auto& stop_events_json = (*ite_bis)[1];
             assert_json_format(stop_events_json.IsArray(), "stopevents is not an array");
-            vector<ParsedRoute::StopEvent> stop_events;
+            if (ite_bis == trips_json.Begin())
+                route = ParsedRoute{stop_events_json.Size(), trip_ids};
+            assert_json_format(stop_events_json.Size() == route.nb_stops,
+                               "all trips of a route should have the same stops");
+            route.add_trip(static_cast<TripIndex>(trip_ids->size() - 1));
             for (auto ite_ter = stop_events_json.Begin(); ite_ter != stop_events_json.End(); ++ite_ter) {
                 assert_json_format(ite_ter->IsArray(), "eventpair-iterator is not an array");
                 assert_json_format(ite_ter->Size() == 2, "eventpair should have 2 elements");
@@ -186,13 +190,27 @@ GtfsParsedData unserialize_gtfs(istream& in) {
                 assert_json_format((*ite_ter)[1].IsInt(), "event-right should be an int");
                 int arrival = (*ite_ter)[0].GetInt();
                 int departure = (*ite_ter)[1].GetInt();
-                stop_events.emplace_back(arrival, departure);
+                route.add_event(arrival, departure);
             }
-            trips.insert({otid, stop_events});
+            assert_json_format(trip_event_time_json.GetInt() == route.orderable_trip_id(route.nb_trips() - 1).first,
+                               "trip_event_time should be the departure time at the first stop");
         }
 
-        ParsedRoute pr(move(trips));
-        routes.insert({label, pr});
+        route.sort_trips();
+        routes.insert({label, move(route)});
+    }
+
+    // the stops of the routes are not serialized : they are deduced (once) from the route labels
+    vector<vector<size_t>> ranked_routes_stops;
+    ranked_routes_stops.reserve(ranked_routes.size());
+    for (auto const& route_label : ranked_routes) {
+        vector<size_t> stop_ranks;
+        for (auto const& stop_id : route_label.to_stop_ids()) {
+            auto stop_rank = stopid_to_rank.find(stop_id);
+            assert_json_format(stop_rank != stopid_to_rank.end(), "unknown stop in route label : " + stop_id);
+            stop_ranks.push_back(stop_rank->second);
+        }
+        ranked_routes_stops.push_back(move(stop_ranks));
     }
 
     GtfsParsedData to_return;
@@ -201,6 +219,7 @@ GtfsParsedData unserialize_gtfs(istream& in) {
     to_return.ranked_stops = ranked_stops;
     to_return.stopid_to_rank = stopid_to_rank;
     to_return.routes = routes;
+    to_return.ranked_routes_stops = move(ranked_routes_stops);
 
     return to_return;
 }
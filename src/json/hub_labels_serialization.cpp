@@ -0,0 +1,78 @@
+#include "hub_labels_serialization.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace uwpreprocess::json {
+
+void serialize_hub_labels_binary(HubLabels const& hub_labels, ostream& out) {
+    uint64_t nb_nodes = hub_labels.nb_nodes();
+    out.write(reinterpret_cast<char const*>(&nb_nodes), sizeof(nb_nodes));
+    out.write(reinterpret_cast<char const*>(hub_labels.order.data()), nb_nodes * sizeof(uint32_t));
+    for (uint32_t node = 0; node < nb_nodes; ++node) {
+        uint32_t label_size = static_cast<uint32_t>(hub_labels.label_end(node) - hub_labels.label_begin(node));
+        out.write(reinterpret_cast<char const*>(&label_size), sizeof(label_size));
+        for (auto entry = hub_labels.label_begin(node); entry != hub_labels.label_end(node); ++entry) {
+            out.write(reinterpret_cast<char const*>(&entry->hub), sizeof(entry->hub));
+            out.write(reinterpret_cast<char const*>(&entry->distance), sizeof(entry->distance));
+        }
+    }
+}
+
+HubLabels unserialize_hub_labels_binary(istream& in) {
+    HubLabels hub_labels;
+
+    uint64_t nb_nodes = 0;
+    in.read(reinterpret_cast<char*>(&nb_nodes), sizeof(nb_nodes));
+    hub_labels.order.resize(nb_nodes);
+    in.read(reinterpret_cast<char*>(hub_labels.order.data()), nb_nodes * sizeof(uint32_t));
+    hub_labels.offsets.reserve(nb_nodes + 1);
+    for (uint64_t node = 0; node < nb_nodes && in; ++node) {
+        uint32_t label_size = 0;
+        in.read(reinterpret_cast<char*>(&label_size), sizeof(label_size));
+        for (uint32_t index = 0; index < label_size && in; ++index) {
+            HubLabels::Entry entry;
+            in.read(reinterpret_cast<char*>(&entry.hub), sizeof(entry.hub));
+            in.read(reinterpret_cast<char*>(&entry.distance), sizeof(entry.distance));
+            hub_labels.entries.push_back(entry);
+        }
+        hub_labels.offsets.push_back(hub_labels.entries.size());
+    }
+    if (!in)
+        throw runtime_error("ERROR : truncated hub labels file");
+    return hub_labels;
+}
+
+void serialize_hub_labels_hluw(HubLabels const& hub_labels, string const& hluw_output_dir) {
+    ofstream out_labels(hluw_output_dir + "hub_labels.bin", ios::binary);
+    serialize_hub_labels_binary(hub_labels, out_labels);
+
+    auto const& statistics = hub_labels.statistics;
+    ofstream out_statistics(hluw_output_dir + "hub_labels_stats.txt");
+    out_statistics << "nb_nodes " << hub_labels.nb_nodes() << "\n";
+    out_statistics << "nb_entries " << statistics.nb_entries << "\n";
+    out_statistics << "average_label_size " << statistics.average_label_size << "\n";
+    out_statistics << "max_label_size " << statistics.max_label_size << "\n";
+    out_statistics << "build_seconds " << statistics.build_seconds << "\n";
+}
+
+bool _check_serialization_idempotent(HubLabels const& hub_labels) {
+    ostringstream oss;
+    serialize_hub_labels_binary(hub_labels, oss);
+
+    istringstream iss(oss.str());
+    HubLabels deserialized = unserialize_hub_labels_binary(iss);
+
+    auto are_entries_equal = [](HubLabels::Entry const& left, HubLabels::Entry const& right) {
+        return left.hub == right.hub && left.distance == right.distance;
+    };
+    return hub_labels.order == deserialized.order && hub_labels.offsets == deserialized.offsets &&
+           equal(hub_labels.entries.begin(), hub_labels.entries.end(), deserialized.entries.begin(),
+                 deserialized.entries.end(), are_entries_equal);
+}
+
+}  // namespace uwpreprocess::json
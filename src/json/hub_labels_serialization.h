@@ -0,0 +1,23 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "graph/hub_labels.h"
+
+namespace uwpreprocess::json {
+
+// binary format (host endianness), the nodes being identified by their rank in the walking graph (the stops being
+// ranked first, in the order of stops.nodes) :
+//      the number of nodes (uint64), then the vertex order (one uint32 rank per hub)
+//      then for each node : its label size (uint32), then for each entry : hub (uint32) + distance (float32)
+void serialize_hub_labels_binary(HubLabels const& hub_labels, std::ostream& out);
+HubLabels unserialize_hub_labels_binary(std::istream& in);
+
+// dumps hub_labels.bin and hub_labels_stats.txt (label sizes and build time) to the HL-UW output dir :
+void serialize_hub_labels_hluw(HubLabels const& hub_labels, std::string const& hluw_output_dir);
+
+bool _check_serialization_idempotent(HubLabels const&);
+
+}  // namespace uwpreprocess::json
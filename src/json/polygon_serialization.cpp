@@ -28,7 +28,9 @@ static void assert_json_format(bool condition, string description) {
         throw IllFormattedPolygonException{description};
 }
 
-static vector<pair<double, double>> parse_polygonfile(istream& polygonfile_stream) {
+using Ring = vector<pair<double, double>>;
+
+static vector<Ring> parse_polygonfile(istream& polygonfile_stream) {
     // EXAMPLE OF POLYGON BUILT WITH https://geojson.io :
     // {
     //   "type": "FeatureCollection",
@@ -78,23 +80,24 @@ static vector<pair<double, double>> parse_polygonfile(istream& polygonfile_strea
     auto& coordinates = geometry["coordinates"];
     assert_json_format(coordinates.IsArray(), "coordinates is not an Array");
 
-    // it seems that the coordinates format is built to allow multiple polygon ?
-    // anyway, we're only interested in the first one :
-    assert_json_format(coordinates.Size() == 1, "there are multiple polygons");
-    auto& first_polygon_coordinates = coordinates[0];
-    assert_json_format(first_polygon_coordinates.IsArray(), "first polygon coords is not an Array");
-
-    vector<pair<double, double>> points;
-    for (auto& coordinate_pair : first_polygon_coordinates.GetArray()) {
-        assert_json_format(coordinate_pair.IsArray(), "coordinate_pair is not an array");
-        assert_json_format(coordinate_pair.Size() == 2, "coordinate_pair has not 2 elements");
-        auto& lon = coordinate_pair[0];
-        auto& lat = coordinate_pair[1];
-        assert_json_format(lon.IsDouble(), "lon is not a double");
-        assert_json_format(lat.IsDouble(), "lat is not a double");
-        points.emplace_back(lon.GetDouble(), lat.GetDouble());
+    // the coordinates of a polygon are a list of rings : the first one is the outer ring, the others are holes :
+    assert_json_format(coordinates.Size() >= 1, "there is no ring in polygon");
+    vector<Ring> rings;
+    for (auto& ring_coordinates : coordinates.GetArray()) {
+        assert_json_format(ring_coordinates.IsArray(), "ring coords is not an Array");
+        Ring ring;
+        for (auto& coordinate_pair : ring_coordinates.GetArray()) {
+            assert_json_format(coordinate_pair.IsArray(), "coordinate_pair is not an array");
+            assert_json_format(coordinate_pair.Size() == 2, "coordinate_pair has not 2 elements");
+            auto& lon = coordinate_pair[0];
+            auto& lat = coordinate_pair[1];
+            assert_json_format(lon.IsDouble(), "lon is not a double");
+            assert_json_format(lat.IsDouble(), "lat is not a double");
+            ring.emplace_back(lon.GetDouble(), lat.GetDouble());
+        }
+        rings.push_back(move(ring));
     }
-    return points;
+    return rings;
 }
 
 BgPolygon unserialize_polygon(string polygonfile_path) {
@@ -109,8 +112,9 @@ BgPolygon unserialize_polygon(string polygonfile_path) {
         throw UnreadablePolygonFileException{polygonfile_path};
     }
 
-    auto points = parse_polygonfile(polygonfile_stream);
-    return create_polygon(points);
+    auto rings = parse_polygonfile(polygonfile_stream);
+    vector<Ring> holes(rings.begin() + 1, rings.end());
+    return create_polygon(rings.front(), holes);
 }
 
 }  // namespace uwpreprocess
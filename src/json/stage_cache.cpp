@@ -0,0 +1,423 @@
+#include "stage_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+
+using namespace std;
+
+namespace uwpreprocess::json {
+
+// must be incremented when the format of an entry (or the output of a cached stage) changes :
+constexpr const uint32_t CACHE_FORMAT_VERSION = 5;
+constexpr const char CACHE_MAGIC[8] = {'U', 'W', 'P', 'C', 'A', 'C', 'H', 'E'};
+
+MappedFile::MappedFile(filesystem::path const& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("ERROR : unable to open file : " + path.string());
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("ERROR : unable to stat file : " + path.string());
+    }
+    length = static_cast<size_t>(file_stat.st_size);
+    if (length > 0) {
+        address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("ERROR : unable to mmap file : " + path.string());
+        }
+        madvise(address, length, MADV_SEQUENTIAL);
+    }
+    close(fd);  // the mapping stays valid after the file is closed
+}
+
+MappedFile::~MappedFile() {
+    if (address != nullptr)
+        munmap(address, length);
+}
+
+static inline uint64_t _mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void ContentHash::update(void const* data, size_t size) {
+    // the content is consumed by words of 8 bytes (the last one being zero-padded), and its size is hashed too :
+    // thus, two consecutive updates can't be confused with a single one.
+    char const* bytes = static_cast<char const*>(data);
+    size_t nb_words = size / sizeof(uint64_t);
+    for (size_t index = 0; index < nb_words; ++index) {
+        uint64_t word;
+        memcpy(&word, bytes + index * sizeof(uint64_t), sizeof(word));
+        state = _mix(state ^ word) + index;
+    }
+    uint64_t last_word = 0;
+    if (size % sizeof(uint64_t) != 0)
+        memcpy(&last_word, bytes + nb_words * sizeof(uint64_t), size % sizeof(uint64_t));
+    state = _mix(state ^ last_word ^ (uint64_t{size} << 3));
+    nb_bytes += size;
+}
+
+void ContentHash::update(string const& value) {
+    update(value.data(), value.size());
+}
+
+void ContentHash::update(double value) {
+    update(&value, sizeof(value));
+}
+
+void ContentHash::update_file(filesystem::path const& path) {
+    MappedFile file{path};
+    update(file.data(), file.size());
+}
+
+void ContentHash::update_folder(filesystem::path const& folder) {
+    vector<filesystem::path> files;
+    for (auto const& entry : filesystem::directory_iterator(folder)) {
+        if (entry.is_regular_file())
+            files.push_back(entry.path());
+    }
+    sort(files.begin(), files.end());  // the directory iteration order is unspecified
+    for (auto const& file : files) {
+        update(file.filename().string());
+        update_file(file);
+    }
+}
+
+void ContentHash::update_polygon(BgPolygon const& polygon) {
+    auto update_ring = [this](BgPolygon::ring_type const& ring) {
+        update(static_cast<double>(ring.size()));
+        for (auto const& point : ring) {
+            update(boost::geometry::get<0>(point));
+            update(boost::geometry::get<1>(point));
+        }
+    };
+    update_ring(polygon.outer());
+    for (auto const& inner : polygon.inners()) {
+        update_ring(inner);
+    }
+}
+
+string ContentHash::hex() const {
+    ostringstream oss;
+    oss << std::hex << setw(16) << setfill('0') << _mix(state ^ nb_bytes);
+    return oss.str();
+}
+
+string osm_stage_key(filesystem::path const& osm_file, BgPolygon const& polygon, float walkspeed_km_per_hour) {
+    ContentHash hash;
+    hash.update(static_cast<double>(CACHE_FORMAT_VERSION));
+    hash.update_file(osm_file);
+    hash.update_polygon(polygon);
+    hash.update(static_cast<double>(walkspeed_km_per_hour));
+    return "osm-" + hash.hex();
+}
+
+string osm_changes_key(string const& osm_key, vector<string> const& change_files) {
+    ContentHash hash;
+    hash.update(osm_key);
+    for (auto const& change_file : change_files) {
+        hash.update_file(change_file);
+    }
+    return osm_key + "-changes-" + hash.hex();
+}
+
+string gtfs_stage_key(filesystem::path const& gtfs_folder, optional<ServiceWindow> const& service_window) {
+    ContentHash hash;
+    hash.update(static_cast<double>(CACHE_FORMAT_VERSION));
+    hash.update_folder(gtfs_folder);
+    if (service_window)  // (the key without service window is unchanged)
+        hash.update(service_window->as_string());
+    return "gtfs-" + hash.hex();
+}
+
+// the entries are plain binary files (host endianness), read back through a MappedFile :
+template <typename T>
+static void _write(ostream& out, T const& value) {
+    static_assert(is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+template <typename T>
+static void _write_array(ostream& out, vector<T> const& values) {
+    static_assert(is_trivially_copyable_v<T>);
+    _write(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<char const*>(values.data()), static_cast<streamsize>(values.size() * sizeof(T)));
+}
+
+static void _write_string(ostream& out, string const& value) {
+    _write(out, static_cast<uint64_t>(value.size()));
+    out.write(value.data(), static_cast<streamsize>(value.size()));
+}
+
+class MappedReader {
+   public:
+    explicit MappedReader(MappedFile const& file_) : file{file_} {}
+
+    template <typename T>
+    T read() {
+        static_assert(is_trivially_copyable_v<T>);
+        T value;
+        memcpy(&value, consume(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    vector<T> read_array() {
+        static_assert(is_trivially_copyable_v<T>);
+        size_t size = read<uint64_t>();
+        if (size > file.size() / sizeof(T))
+            throw runtime_error("ERROR : truncated cache entry");
+        vector<T> values(size);
+        if (size > 0)
+            memcpy(values.data(), consume(size * sizeof(T)), size * sizeof(T));
+        return values;
+    }
+
+    string read_string() {
+        size_t size = read<uint64_t>();
+        return string(consume(size), size);
+    }
+
+    char const* consume(size_t size) {
+        if (size > file.size() - position)
+            throw runtime_error("ERROR : truncated cache entry");
+        char const* data = file.data() + position;
+        position += size;
+        return data;
+    }
+
+   private:
+    MappedFile const& file;
+    size_t position = 0;
+};
+
+static void _write_header(ostream& out) {
+    out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    _write(out, CACHE_FORMAT_VERSION);
+}
+
+static bool _read_header(MappedReader& reader) {
+    return memcmp(reader.consume(sizeof(CACHE_MAGIC)), CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+           reader.read<uint32_t>() == CACHE_FORMAT_VERSION;
+}
+
+// an edge of the OSM stage (its nodes are not ranked yet, and their locations are the ends of its geometry) :
+struct CachedEdge {
+    NodeId node_from;
+    NodeId node_to;
+    uint64_t geometry_offset;
+    uint32_t geometry_length;
+    uint32_t geometry_is_reversed;
+    float length_m;
+    float weight;
+};
+
+StageCache::StageCache(filesystem::path cache_dir_) : cache_dir{move(cache_dir_)} {
+    filesystem::create_directories(cache_dir);
+}
+
+bool StageCache::load_osm_stage(string const& key, OsmWaysGraph& graph) const {
+    filesystem::path entry = cache_dir / (key + ".bin");
+    if (!filesystem::exists(entry))
+        return false;
+
+    MappedFile file{entry};
+    MappedReader reader{file};
+    if (!_read_header(reader))
+        return false;
+
+    graph.ways.way_ids = reader.read_array<WayId>();
+    graph.ways.speed_factors = reader.read_array<float>();
+    graph.ways.offsets = reader.read_array<size_t>();
+    vector<NodeOsmId> node_ids = reader.read_array<NodeOsmId>();
+    vector<osmium::Location> node_locations = reader.read_array<osmium::Location>();
+    if (graph.ways.offsets.size() != graph.ways.way_ids.size() + 1 ||
+        graph.ways.speed_factors.size() != graph.ways.way_ids.size() || node_ids.size() != node_locations.size())
+        throw runtime_error("ERROR : inconsistent cache entry : " + entry.string());
+    graph.ways.nodes.clear();
+    graph.ways.nodes.reserve(node_ids.size());
+    for (size_t node_index = 0; node_index < node_ids.size(); ++node_index) {
+        graph.ways.nodes.emplace_back(node_ids[node_index], node_locations[node_index]);
+    }
+    graph.node_use_counter = count_node_usage(graph.ways);
+
+    // the geometries must be loaded before the edges, as the edges are built from them :
+    graph.geometries.assign(reader.read_array<osmium::Location>());
+    graph.edge_offsets = reader.read_array<size_t>();
+    size_t nb_edges = reader.read<uint64_t>();
+    graph.edges.clear();
+    graph.edges.reserve(nb_edges);
+    for (size_t edge_index = 0; edge_index < nb_edges; ++edge_index) {
+        auto cached = reader.read<CachedEdge>();
+        GeometryView geometry{cached.geometry_offset, cached.geometry_length, cached.geometry_is_reversed != 0};
+        if (geometry.length == 0 || geometry.offset + geometry.length > graph.geometries.locations.size())
+            throw runtime_error("ERROR : inconsistent cache entry : " + entry.string());
+        graph.edges.emplace_back(cached.node_from, Node::UNRANKED, cached.node_to, Node::UNRANKED, graph.geometries,
+                                 geometry, cached.length_m, cached.weight);
+    }
+    if (graph.edge_offsets.size() != graph.ways.size() + 1 || graph.edge_offsets.back() != graph.edges.size())
+        throw runtime_error("ERROR : inconsistent cache entry : " + entry.string());
+    return true;
+}
+
+void StageCache::store_osm_stage(string const& key, OsmWaysGraph const& graph) const {
+    filesystem::path entry = cache_dir / (key + ".bin");
+    filesystem::path temporary = cache_dir / (key + ".bin.tmp");
+    {
+        ofstream out(temporary, ios::binary);
+        _write_header(out);
+        _write_array(out, graph.ways.way_ids);
+        _write_array(out, graph.ways.speed_factors);
+        _write_array(out, graph.ways.offsets);
+        vector<NodeOsmId> node_ids;
+        vector<osmium::Location> node_locations;
+        node_ids.reserve(graph.ways.nodes.size());
+        node_locations.reserve(graph.ways.nodes.size());
+        for (auto const& [node_id, location] : graph.ways.nodes) {
+            node_ids.push_back(node_id);
+            node_locations.push_back(location);
+        }
+        _write_array(out, node_ids);
+        _write_array(out, node_locations);
+
+        _write_array(out, graph.geometries.locations);
+        _write_array(out, graph.edge_offsets);
+        _write(out, static_cast<uint64_t>(graph.edges.size()));
+        for (auto const& edge : graph.edges) {
+            _write(out, CachedEdge{edge.node_from.id, edge.node_to.id, edge.geometry.offset, edge.geometry.length,
+                                   edge.geometry.is_reversed, edge.length_m, edge.weight});
+        }
+        if (!out)
+            throw runtime_error("ERROR : unable to write cache entry : " + temporary.string());
+    }
+    filesystem::rename(temporary, entry);
+}
+
+// a snapped stop : its location, and the id and location of its closest node
+struct CachedSnappedStop {
+    double stop_lon;
+    double stop_lat;
+    NodeId closest_node;
+    osmium::Location closest_location;
+};
+
+bool StageCache::load_snapping(string const& key, PreviousSnapping& snapping) const {
+    filesystem::path entry = cache_dir / (key + ".snapping");
+    if (!filesystem::exists(entry))
+        return false;
+
+    MappedFile file{entry};
+    MappedReader reader{file};
+    if (!_read_header(reader))
+        return false;
+    size_t nb_stops = reader.read<uint64_t>();
+    snapping.stops.clear();
+    for (size_t stop_index = 0; stop_index < nb_stops; ++stop_index) {
+        string stop_id = reader.read_string();
+        auto cached = reader.read<CachedSnappedStop>();
+        snapping.stops.insert(
+            {stop_id, {cached.stop_lon, cached.stop_lat, Node{cached.closest_node, cached.closest_location}}});
+    }
+    return true;
+}
+
+void StageCache::store_snapping(string const& key, WalkingGraph const& graph) const {
+    // the location of the closest node of a stop is the end of the edge from the stop :
+    unordered_map<NodeId, osmium::Location> closest_locations;
+    for (auto const& stop : graph.stops_with_closest_node) {
+        closest_locations.insert({stop.closest_node, osmium::Location{}});
+    }
+    for (auto const& edge : graph.edges_with_stops_bidirectional) {
+        auto closest_location = closest_locations.find(edge.node_to.id);
+        if (closest_location != closest_locations.end())
+            closest_location->second = edge.node_to.location;
+    }
+
+    filesystem::path entry = cache_dir / (key + ".snapping");
+    filesystem::path temporary = cache_dir / (key + ".snapping.tmp");
+    {
+        ofstream out(temporary, ios::binary);
+        _write_header(out);
+        _write(out, static_cast<uint64_t>(graph.stops_with_closest_node.size()));
+        for (auto const& stop : graph.stops_with_closest_node) {
+            _write_string(out, stop.id);
+            _write(out, CachedSnappedStop{stop.lon, stop.lat, stop.closest_node,
+                                          closest_locations.at(stop.closest_node)});
+        }
+        if (!out)
+            throw runtime_error("ERROR : unable to write cache entry : " + temporary.string());
+    }
+    filesystem::rename(temporary, entry);
+}
+
+bool StageCache::load_gtfs_stage(string const& key,
+                                 filesystem::path const& gtfs_json,
+                                 filesystem::path const& stoptimes,
+                                 vector<Stop>& stops) const {
+    filesystem::path entry = cache_dir / key;
+    if (!filesystem::exists(entry / "stops.bin"))
+        return false;
+
+    MappedFile file{entry / "stops.bin"};
+    MappedReader reader{file};
+    if (!_read_header(reader))
+        return false;
+    size_t nb_stops = reader.read<uint64_t>();
+    stops.clear();
+    stops.reserve(nb_stops);
+    for (size_t stop_index = 0; stop_index < nb_stops; ++stop_index) {
+        double lon = reader.read<double>();
+        double lat = reader.read<double>();
+        string id = reader.read_string();
+        string name = reader.read_string();
+        stops.emplace_back(lon, lat, id, name);
+    }
+
+    filesystem::copy_file(entry / "gtfs.json", gtfs_json, filesystem::copy_options::overwrite_existing);
+    filesystem::copy_file(entry / "stoptimes.txt", stoptimes, filesystem::copy_options::overwrite_existing);
+    return true;
+}
+
+void StageCache::store_gtfs_stage(string const& key,
+                                  filesystem::path const& gtfs_json,
+                                  filesystem::path const& stoptimes,
+                                  vector<Stop> const& stops) const {
+    filesystem::path entry = cache_dir / key;
+    filesystem::path temporary = cache_dir / (key + ".tmp");
+    filesystem::remove_all(temporary);
+    filesystem::create_directories(temporary);
+    filesystem::copy_file(gtfs_json, temporary / "gtfs.json");
+    filesystem::copy_file(stoptimes, temporary / "stoptimes.txt");
+    {
+        ofstream out(temporary / "stops.bin", ios::binary);
+        _write_header(out);
+        _write(out, static_cast<uint64_t>(stops.size()));
+        for (auto const& stop : stops) {
+            _write(out, stop.lon);
+            _write(out, stop.lat);
+            _write_string(out, stop.id);
+            _write_string(out, stop.name);
+        }
+        if (!out)
+            throw runtime_error("ERROR : unable to write cache entry : " + temporary.string());
+    }
+    filesystem::remove_all(entry);  // a previous entry with the same key is necessarily identical
+    filesystem::rename(temporary, entry);
+}
+
+}  // namespace uwpreprocess::json
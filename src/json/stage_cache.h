@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "graph/extending_with_stops.h"
+#include "graph/graphtypes.h"
+#include "graph/osm_changes.h"
+#include "graph/polygon.h"
+#include "graph/types.h"
+#include "graph/walking_graph.h"
+#include "gtfs/service_calendar.h"
+
+namespace uwpreprocess::json {
+
+// A read-only memory mapping of a whole file (an empty file is mapped as an empty range) :
+class MappedFile {
+   public:
+    explicit MappedFile(std::filesystem::path const& path);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    inline char const* data() const { return static_cast<char const*>(address); }
+    inline size_t size() const { return length; }
+
+   private:
+    void* address = nullptr;
+    size_t length = 0;
+};
+
+// A 64 bits hash of some content (not cryptographic : it only has to detect that an input has changed) :
+class ContentHash {
+   public:
+    void update(void const* data, size_t size);
+    void update(std::string const& value);
+    void update(double value);
+    void update_file(std::filesystem::path const& path);      // content of the file
+    void update_folder(std::filesystem::path const& folder);  // names and contents of the regular files of the folder
+    void update_polygon(BgPolygon const& polygon);
+    std::string hex() const;
+
+   private:
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    uint64_t nb_bytes = 0;
+};
+
+std::string osm_stage_key(std::filesystem::path const& osm_file, BgPolygon const& polygon, float walkspeed_km_per_hour);
+// the key of the OSM stage updated by some change files (in their order) :
+std::string osm_changes_key(std::string const& osm_key, std::vector<std::string> const& change_files);
+std::string gtfs_stage_key(std::filesystem::path const& gtfs_folder,
+                           std::optional<ServiceWindow> const& service_window = std::nullopt);
+
+// A content-addressed cache of the preprocessing stages : the output of a stage is stored under a key that hashes all
+// its inputs (thus, a changed input simply misses the cache, and no invalidation is ever needed).
+//  - OSM stage  : the ways, edges and geometries of the OSM graph (kept by way, so that change files can be applied)
+//  - snapping   : the closest node of each stop, in the walking-graph built from an OSM stage (same key)
+//  - GTFS stage : the dumped gtfs.json and stoptimes.txt, and the stops passed to the walking-graph
+// The entries are written to a temporary file, then renamed : an interrupted run never leaves a corrupted entry.
+class StageCache {
+   public:
+    explicit StageCache(std::filesystem::path cache_dir_);
+
+    bool load_osm_stage(std::string const& key, OsmWaysGraph& graph) const;
+    void store_osm_stage(std::string const& key, OsmWaysGraph const& graph) const;
+
+    bool load_snapping(std::string const& key, PreviousSnapping& snapping) const;  // (changed_nodes is left as is)
+    void store_snapping(std::string const& key, WalkingGraph const& graph) const;
+
+    // on a hit, the cached gtfs.json and stoptimes.txt are copied to the given paths :
+    bool load_gtfs_stage(std::string const& key,
+                         std::filesystem::path const& gtfs_json,
+                         std::filesystem::path const& stoptimes,
+                         std::vector<Stop>& stops) const;
+    void store_gtfs_stage(std::string const& key,
+                          std::filesystem::path const& gtfs_json,
+                          std::filesystem::path const& stoptimes,
+                          std::vector<Stop> const& stops) const;
+
+   private:
+    std::filesystem::path cache_dir;
+};
+
+}  // namespace uwpreprocess::json
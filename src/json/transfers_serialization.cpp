@@ -0,0 +1,70 @@
+#include "transfers_serialization.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace uwpreprocess::json {
+
+void serialize_transfers_binary(vector<Transfer> const& transfers, ostream& out) {
+    uint64_t nb_transfers = transfers.size();
+    out.write(reinterpret_cast<char const*>(&nb_transfers), sizeof(nb_transfers));
+    for (auto const& transfer : transfers) {
+        out.write(reinterpret_cast<char const*>(&transfer.from_stop), sizeof(transfer.from_stop));
+        out.write(reinterpret_cast<char const*>(&transfer.to_stop), sizeof(transfer.to_stop));
+        out.write(reinterpret_cast<char const*>(&transfer.walking_seconds), sizeof(transfer.walking_seconds));
+    }
+}
+
+vector<Transfer> unserialize_transfers_binary(istream& in) {
+    uint64_t nb_transfers = 0;
+    in.read(reinterpret_cast<char*>(&nb_transfers), sizeof(nb_transfers));
+    vector<Transfer> transfers(nb_transfers);
+    for (auto& transfer : transfers) {
+        in.read(reinterpret_cast<char*>(&transfer.from_stop), sizeof(transfer.from_stop));
+        in.read(reinterpret_cast<char*>(&transfer.to_stop), sizeof(transfer.to_stop));
+        in.read(reinterpret_cast<char*>(&transfer.walking_seconds), sizeof(transfer.walking_seconds));
+    }
+    if (!in)
+        throw runtime_error("ERROR : truncated transfers file");
+    return transfers;
+}
+
+static string _csv_field(string const& value) {
+    if (value.find_first_of(",\"\n") == string::npos)
+        return value;
+    string quoted = "\"";
+    for (char c : value) {
+        if (c == '"')
+            quoted.push_back('"');
+        quoted.push_back(c);
+    }
+    quoted.push_back('"');
+    return quoted;
+}
+
+void serialize_transfers_gtfs(vector<Transfer> const& transfers,
+                              vector<StopWithClosestNode> const& stops,
+                              ostream& out) {
+    // transfer_type=2 means that the transfer requires a minimal time (the walking time) :
+    out << "from_stop_id,to_stop_id,transfer_type,min_transfer_time\n";
+    for (auto const& transfer : transfers) {
+        out << _csv_field(stops.at(transfer.from_stop).id) << ",";
+        out << _csv_field(stops.at(transfer.to_stop).id) << ",";
+        out << "2,";
+        out << static_cast<long>(ceil(transfer.walking_seconds)) << "\n";
+    }
+}
+
+bool _check_serialization_idempotent(vector<Transfer> const& transfers) {
+    ostringstream oss;
+    serialize_transfers_binary(transfers, oss);
+
+    istringstream iss(oss.str());
+    vector<Transfer> deserialized = unserialize_transfers_binary(iss);
+    return transfers == deserialized;
+}
+
+}  // namespace uwpreprocess::json
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "graph/transfers.h"
+#include "graph/types.h"
+
+namespace uwpreprocess::json {
+
+// binary format (host endianness) : the number of transfers (uint64), then for each transfer :
+//      from_stop (uint32) + to_stop (uint32) + walking_seconds (float32)
+// the stops are identified by their rank in the walking graph (see Transfer)
+void serialize_transfers_binary(std::vector<Transfer> const& transfers, std::ostream& out);
+std::vector<Transfer> unserialize_transfers_binary(std::istream& in);
+
+// GTFS transfers.txt format : the stops are identified by their stop_id, and the walking time is rounded up
+void serialize_transfers_gtfs(std::vector<Transfer> const& transfers,
+                              std::vector<StopWithClosestNode> const& stops,
+                              std::ostream& out);
+
+bool _check_serialization_idempotent(std::vector<Transfer> const&);
+
+}  // namespace uwpreprocess::json
@@ -1,5 +1,6 @@
 #include "walking_graph_serialization.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <unordered_map>
@@ -13,7 +14,13 @@ using namespace std;
 
 namespace uwpreprocess::json {
 
-void dump_geojson_graph(ostream& out, vector<Edge> const& edges, bool allow_unranked) {
+void dump_geojson_graph(ostream& out,
+                        vector<Edge> const& edges,
+                        GeometryArena const& geometries,
+                        NodeNames const& node_names,
+                        bool allow_unranked,
+                        vector<WeightProfile> const& weight_profiles,
+                        float walkspeed_km_per_hour) {
     // EXPECTED OUTPUT :
     // {
     //     "type": "FeatureCollection",
@@ -45,34 +52,57 @@ void dump_geojson_graph(ostream& out, vector<Edge> const& edges, bool allow_unra
     //         ... other features ...
     //     ]
     // }
+    // With weight profiles, the collection also has a "walkspeeds_km_per_hour" array (the walkspeed of the weights of
+    // the edges first, then the one of each profile), and the properties of each edge a "weights" array (same order).
 
     rapidjson::Document doc(rapidjson::kObjectType);
     rapidjson::Document::AllocatorType& a = doc.GetAllocator();
     doc.AddMember("type", "FeatureCollection", a);
+    if (!weight_profiles.empty()) {
+        rapidjson::Value walkspeeds(rapidjson::kArrayType);
+        walkspeeds.PushBack(walkspeed_km_per_hour, a);
+        for (auto const& profile : weight_profiles) {
+            walkspeeds.PushBack(profile.walkspeed_km_per_hour, a);
+        }
+        doc.AddMember("walkspeeds_km_per_hour", walkspeeds, a);
+    }
 
     rapidjson::Value features(rapidjson::kArrayType);
-    for (auto& edge : edges) {
+    for (size_t edge_index = 0; edge_index < edges.size(); ++edge_index) {
+        Edge const& edge = edges[edge_index];
         // coordinates :
         rapidjson::Value coordinates(rapidjson::kArrayType);
-        for (auto& node_location : edge.geometry) {
+        for (auto& node_location : geometries.polyline(edge.geometry)) {
             rapidjson::Value loc(rapidjson::kArrayType);
             loc.PushBack(rapidjson::Value().SetDouble(node_location.lon()), a);
             loc.PushBack(rapidjson::Value().SetDouble(node_location.lat()), a);
             coordinates.PushBack(loc, a);
         }
 
-        // properties :
+        // properties (node names are expanded from the NodeNames table) :
+        string node_from = node_names.id(edge.node_from.id);
+        string node_to = node_names.id(edge.node_to.id);
+        string node_from_url = node_names.url(edge.node_from.id);
+        string node_to_url = node_names.url(edge.node_to.id);
         rapidjson::Value properties(rapidjson::kObjectType);
         size_t node_from_rank = allow_unranked ? edge.node_from.get_rank_or_unranked() : edge.node_from.get_rank();
         properties.AddMember("node_from_rank", node_from_rank, a);
-        properties.AddMember("node_from", rapidjson::Value().SetString(edge.node_from.id.c_str(), a), a);
+        properties.AddMember("node_from", rapidjson::Value().SetString(node_from.c_str(), a), a);
         size_t node_to_rank = allow_unranked ? edge.node_to.get_rank_or_unranked() : edge.node_to.get_rank();
         properties.AddMember("node_to_rank", node_to_rank, a);
-        properties.AddMember("node_to", rapidjson::Value().SetString(edge.node_to.id.c_str(), a), a);
-        properties.AddMember("node_from_url", rapidjson::Value().SetString(edge.node_from.url.c_str(), a), a);
-        properties.AddMember("node_to_url", rapidjson::Value().SetString(edge.node_to.url.c_str(), a), a);
+        properties.AddMember("node_to", rapidjson::Value().SetString(node_to.c_str(), a), a);
+        properties.AddMember("node_from_url", rapidjson::Value().SetString(node_from_url.c_str(), a), a);
+        properties.AddMember("node_to_url", rapidjson::Value().SetString(node_to_url.c_str(), a), a);
         properties.AddMember("weight", edge.weight, a);
         properties.AddMember("length_meters", edge.length_m, a);
+        if (!weight_profiles.empty()) {
+            rapidjson::Value weights(rapidjson::kArrayType);
+            weights.PushBack(edge.weight, a);
+            for (auto const& profile : weight_profiles) {
+                weights.PushBack(profile.weights[edge_index], a);
+            }
+            properties.AddMember("weights", weights, a);
+        }
 
         // geometry :
         rapidjson::Value geometry(rapidjson::kObjectType);
@@ -95,7 +125,7 @@ void dump_geojson_graph(ostream& out, vector<Edge> const& edges, bool allow_unra
     doc.Accept(writer);
 }
 
-void dump_geojson_stops(ostream& out, vector<StopWithClosestNode> const& stops) {
+void dump_geojson_stops(ostream& out, vector<StopWithClosestNode> const& stops, NodeNames const& node_names) {
     rapidjson::Document doc(rapidjson::kObjectType);
     rapidjson::Document::AllocatorType& a = doc.GetAllocator();
     doc.AddMember("type", "FeatureCollection", a);
@@ -114,11 +144,13 @@ void dump_geojson_stops(ostream& out, vector<StopWithClosestNode> const& stops)
         geometry.AddMember("type", "Point", a);
 
         // properties :
+        string closest_node_id = node_names.id(stop.closest_node);
+        string closest_node_url = node_names.url(stop.closest_node);
         rapidjson::Value properties(rapidjson::kObjectType);
         properties.AddMember("stop_id", rapidjson::Value().SetString(stop.id.c_str(), a), a);
         properties.AddMember("stop_name", rapidjson::Value().SetString(stop.name.c_str(), a), a);
-        properties.AddMember("closest_node_id", rapidjson::Value().SetString(stop.closest_node_id.c_str(), a), a);
-        properties.AddMember("closest_node_url", rapidjson::Value().SetString(stop.closest_node_url.c_str(), a), a);
+        properties.AddMember("closest_node_id", rapidjson::Value().SetString(closest_node_id.c_str(), a), a);
+        properties.AddMember("closest_node_url", rapidjson::Value().SetString(closest_node_url.c_str(), a), a);
 
         // feature :
         rapidjson::Value feature(rapidjson::kObjectType);
@@ -148,7 +180,11 @@ static void assert_json_format(bool condition, string description) {
         throw IllFormattedWalkingGraphException{description};
 }
 
-vector<Edge> parse_geojson_graph(istream& in) {
+vector<Edge> parse_geojson_graph(istream& in,
+                                 NodeNames& node_names,
+                                 GeometryArena& geometries,
+                                 vector<WeightProfile>& weight_profiles,
+                                 float& walkspeed_km_per_hour) {
     rapidjson::IStreamWrapper stream_wrapper(in);
     rapidjson::Document doc;
     doc.ParseStream(stream_wrapper);
@@ -159,6 +195,22 @@ vector<Edge> parse_geojson_graph(istream& in) {
 
     assert_json_format(features.IsArray(), "features is not an array");
 
+    // weight profiles (the first walkspeed is the one of the weights of the edges themselves) :
+    weight_profiles.clear();
+    walkspeed_km_per_hour = 0;
+    if (doc.HasMember("walkspeeds_km_per_hour")) {
+        auto& walkspeeds = doc["walkspeeds_km_per_hour"];
+        assert_json_format(walkspeeds.IsArray(), "walkspeeds_km_per_hour is not an array");
+        assert_json_format(walkspeeds.Size() >= 1, "walkspeeds_km_per_hour is empty");
+        for (auto& walkspeed : walkspeeds.GetArray()) {
+            assert_json_format(walkspeed.IsNumber(), "walkspeed is not a number");
+        }
+        walkspeed_km_per_hour = static_cast<float>(walkspeeds[0].GetDouble());
+        for (rapidjson::SizeType index = 1; index < walkspeeds.Size(); ++index) {
+            weight_profiles.push_back({static_cast<float>(walkspeeds[index].GetDouble()), {}});
+        }
+    }
+
     vector<Edge> edges;
     for (auto ite = features.Begin(); ite != features.End(); ++ite) {
         auto& feature = *ite;
@@ -188,7 +240,6 @@ vector<Edge> parse_geojson_graph(istream& in) {
         auto& coordinates = geometry["coordinates"];
         assert_json_format(coordinates.IsArray(), "coordinates is not an Array");
 
-        Polyline polyline;
         for (auto& coordinate_pair : coordinates.GetArray()) {
             assert_json_format(coordinate_pair.IsArray(), "coordinate_pair is not an array");
             assert_json_format(coordinate_pair.Size() == 2, "coordinate_pair has not 2 elements");
@@ -196,17 +247,32 @@ vector<Edge> parse_geojson_graph(istream& in) {
             auto& lat = coordinate_pair[1];
             assert_json_format(lon.IsDouble(), "lon is not a double");
             assert_json_format(lat.IsDouble(), "lat is not a double");
-            polyline.emplace_back(lon.GetDouble(), lat.GetDouble());
+            geometries.push_back(osmium::Location{lon.GetDouble(), lat.GetDouble()});
         }
 
-        NodeId node_from_id = properties["node_from"].GetString();
+        NodeId node_from_id = node_names.parse(properties["node_from"].GetString());
         size_t node_from_rank = properties["node_from_rank"].GetUint64();
-        NodeId node_to_id = properties["node_to"].GetString();
+        NodeId node_to_id = node_names.parse(properties["node_to"].GetString());
         size_t node_to_rank = properties["node_to_rank"].GetUint64();
         float length_m = static_cast<float>(properties["length_meters"].GetDouble());
         float weight = static_cast<float>(properties["weight"].GetDouble());
 
-        edges.emplace_back(node_from_id, node_from_rank, node_to_id, node_to_rank, move(polyline), length_m, weight);
+        if (!weight_profiles.empty()) {
+            assert_json_format(properties.HasMember("weights"), "properties has no 'weights'");
+            auto& weights = properties["weights"];
+            assert_json_format(weights.IsArray(), "weights is not an array");
+            assert_json_format(weights.Size() == weight_profiles.size() + 1, "weights has not one weight by walkspeed");
+            for (size_t profile_index = 0; profile_index < weight_profiles.size(); ++profile_index) {
+                auto& profile_weight = weights[static_cast<rapidjson::SizeType>(profile_index + 1)];
+                assert_json_format(profile_weight.IsNumber(), "weight is not a number");
+                weight_profiles[profile_index].weights.push_back(static_cast<float>(profile_weight.GetDouble()));
+            }
+        }
+
+        GeometryView polyline = geometries.close_polyline();
+        assert_json_format(polyline.length >= 2, "coordinates has less than 2 elements");
+        edges.emplace_back(node_from_id, node_from_rank, node_to_id, node_to_rank, geometries, polyline, length_m,
+                           weight);
     }
     return edges;
 }
@@ -258,22 +324,23 @@ void dump_geojson_line(ostream& out, BgPolygon::ring_type const& ring) {
 
 
 void serialize_walking_graph(WalkingGraph const& graph, ostream& out) {
-    dump_geojson_graph(out, graph.edges_with_stops_bidirectional, false);
+    dump_geojson_graph(out, graph.edges_with_stops_bidirectional, graph.geometries, graph.node_names, false,
+                       graph.weight_profiles, graph.walkspeed_km_per_hour);
 }
 
 
 WalkingGraph unserialize_walking_graph(istream& in) {
     WalkingGraph deserialized;
-    deserialized.edges_with_stops_bidirectional = parse_geojson_graph(in);
+    deserialized.edges_with_stops_bidirectional =
+        parse_geojson_graph(in, deserialized.node_names, deserialized.geometries, deserialized.weight_profiles,
+                            deserialized.walkspeed_km_per_hour);
 
-    size_t edge_rank = 0;
+    // the number of nodes is deduced from the highest rank (sources only, as each edge has its reversed edge) :
+    size_t nb_nodes = 0;
     for (auto& edge : deserialized.edges_with_stops_bidirectional) {
-        auto desired_size = edge.node_from.get_rank() + 1;
-        if (deserialized.node_to_out_edges.size() < desired_size) {
-            deserialized.node_to_out_edges.resize(desired_size);
-        }
-        deserialized.node_to_out_edges[edge.node_from.get_rank()].push_back(edge_rank++);
+        nb_nodes = max(nb_nodes, edge.node_from.get_rank() + 1);
     }
+    deserialized.out_edges = CsrAdjacency::build(deserialized.edges_with_stops_bidirectional, nb_nodes);
     deserialized.check_structures_consistency();
     return deserialized;
 }
@@ -291,11 +358,28 @@ void serialize_walking_graph_hluw(WalkingGraph const& graph, string const& hluw_
     ofstream out_edges(hluw_output_dir + "graph.edgefile");
     out_edges << fixed << setprecision(0);  // displays integer weight
     for (auto& edge : graph.edges_with_stops_bidirectional) {
-        out_edges << edge.node_from.id << " ";
-        out_edges << edge.node_to.id << " ";
+        out_edges << graph.node_names.id(edge.node_from.id) << " ";
+        out_edges << graph.node_names.id(edge.node_to.id) << " ";
         out_edges << edge.weight << "\n";
     }
 
+    // each weight profile has its own walkspeed file and edgefile, suffixed by its index (starting at 1) :
+    for (size_t profile_index = 0; profile_index < graph.weight_profiles.size(); ++profile_index) {
+        auto const& profile = graph.weight_profiles[profile_index];
+        string suffix = "." + to_string(profile_index + 1);
+        ofstream out_profile_walkspeed(hluw_output_dir + "walkspeed_km_per_hour" + suffix + ".txt");
+        out_profile_walkspeed << profile.walkspeed_km_per_hour << "\n";
+
+        ofstream out_profile_edges(hluw_output_dir + "graph" + suffix + ".edgefile");
+        out_profile_edges << fixed << setprecision(0);  // displays integer weight
+        for (size_t edge_index = 0; edge_index < graph.edges_with_stops_bidirectional.size(); ++edge_index) {
+            auto const& edge = graph.edges_with_stops_bidirectional[edge_index];
+            out_profile_edges << graph.node_names.id(edge.node_from.id) << " ";
+            out_profile_edges << graph.node_names.id(edge.node_to.id) << " ";
+            out_profile_edges << profile.weights[edge_index] << "\n";
+        }
+    }
+
     // nodes :
     ofstream out_nodes(hluw_output_dir + "stops.nodes");
     for (auto& stop : graph.stops_with_closest_node) {
@@ -304,7 +388,7 @@ void serialize_walking_graph_hluw(WalkingGraph const& graph, string const& hluw_
 
     // stops geojson (used by the HL-UW server) :
     ofstream out_stops(hluw_output_dir + "stops.geojson");
-    dump_geojson_stops(out_stops, graph.stops_with_closest_node);
+    dump_geojson_stops(out_stops, graph.stops_with_closest_node, graph.node_names);
 }
 
 bool _check_serialization_idempotent(WalkingGraph const& graph) {
@@ -315,9 +399,24 @@ bool _check_serialization_idempotent(WalkingGraph const& graph) {
     istringstream iss(oss.str());
     WalkingGraph deserialized = unserialize_walking_graph(iss);
 
-    bool are_edges_equal = graph.edges_with_stops_bidirectional == deserialized.edges_with_stops_bidirectional;
-    bool are_node_to_out_edges_equal = graph.node_to_out_edges == deserialized.node_to_out_edges;
-    return are_edges_equal && are_node_to_out_edges_equal;
+    // node ids are only comparable if both graphs have interned their stops in the same order :
+    bool are_node_names_equal = graph.node_names.stop_ids == deserialized.node_names.stop_ids;
+    // the deserialized geometries are not shared anymore by reversed edges, so their content is compared :
+    bool are_edges_equal = uwpreprocess::are_edges_equal(graph.edges_with_stops_bidirectional, graph.geometries,
+                                                         deserialized.edges_with_stops_bidirectional,
+                                                         deserialized.geometries);
+    bool are_out_edges_equal = graph.out_edges == deserialized.out_edges;
+    // (the walkspeeds are only serialized along with the weight profiles) :
+    bool are_weight_profiles_equal = graph.weight_profiles.size() == deserialized.weight_profiles.size();
+    for (size_t index = 0; are_weight_profiles_equal && index < graph.weight_profiles.size(); ++index) {
+        auto const& profile = graph.weight_profiles[index];
+        auto const& deserialized_profile = deserialized.weight_profiles[index];
+        are_weight_profiles_equal = profile.walkspeed_km_per_hour == deserialized_profile.walkspeed_km_per_hour &&
+                                    profile.weights == deserialized_profile.weights;
+    }
+    if (!graph.weight_profiles.empty())
+        are_weight_profiles_equal &= graph.walkspeed_km_per_hour == deserialized.walkspeed_km_per_hour;
+    return are_node_names_equal && are_edges_equal && are_out_edges_equal && are_weight_profiles_equal;
 }
 
 
@@ -13,9 +13,23 @@
 
 namespace uwpreprocess::json {
 
-void dump_geojson_graph(std::ostream& out, std::vector<Edge> const& edges, bool allow_unranked);
-void dump_geojson_stops(std::ostream& out, std::vector<StopWithClosestNode> const& stops);
-std::vector<Edge> parse_geojson_graph(std::istream& in);
+// if weight profiles are given, each edge also has the weights of all the walkspeeds (its own weight first) :
+void dump_geojson_graph(std::ostream& out,
+                        std::vector<Edge> const& edges,
+                        GeometryArena const& geometries,
+                        NodeNames const& node_names,
+                        bool allow_unranked,
+                        std::vector<WeightProfile> const& weight_profiles = {},
+                        float walkspeed_km_per_hour = 0);
+void dump_geojson_stops(std::ostream& out,
+                        std::vector<StopWithClosestNode> const& stops,
+                        NodeNames const& node_names);
+// (the weight profiles, and the walkspeed of the edges, are only filled if the graph was dumped with weight profiles) :
+std::vector<Edge> parse_geojson_graph(std::istream& in,
+                                      NodeNames& node_names,
+                                      GeometryArena& geometries,
+                                      std::vector<WeightProfile>& weight_profiles,
+                                      float& walkspeed_km_per_hour);
 void dump_geojson_line(std::ostream& out, BgPolygon::ring_type const&);
 
 void serialize_walking_graph(WalkingGraph const&, std::ostream& out);
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <osmium/geom/haversine.hpp>
+
+#include "graph/distances.h"
+#include "graph/graph.h"
+#include "graph/graphtypes.h"
+#include "json/polygon_serialization.h"
+
+// Microbenchmark of the distance kernels, on the polylines of the edges of a real OSM graph (e.g. Ile-de-France) :
+// each kernel computes the length of every edge, as the graph construction does.
+
+static constexpr const int NB_REPETITIONS = 10;
+
+template <typename Function>
+static double _measure_seconds(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    for (int repetition = 0; repetition < NB_REPETITIONS; ++repetition) {
+        function();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / NB_REPETITIONS;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cout << "Usage:  " << argv[0] << "  <osm_file>  <polygon_file>" << std::endl;
+        std::exit(0);
+    }
+    const std::string osm_file = argv[1];
+    const std::string polygon_file = argv[2];
+
+    std::cout << "Building OSM graph" << std::endl;
+    uwpreprocess::BgPolygon polygon = uwpreprocess::json::unserialize_polygon(polygon_file);
+    uwpreprocess::GeometryArena geometries;
+    std::vector<uwpreprocess::Edge> edges = uwpreprocess::osm_to_graph(osm_file, polygon, 4.7, geometries);
+    size_t nb_segments = geometries.locations.size() - edges.size();
+    std::cout << "Number of edges    = " << edges.size() << std::endl;
+    std::cout << "Number of segments = " << nb_segments << std::endl;
+    std::cout << "Best kernel        = " << uwpreprocess::to_string(uwpreprocess::best_distance_kernel()) << std::endl;
+    std::cout << std::endl;
+
+    // reference = the previous computation of the lengths, segment by segment :
+    std::vector<float> reference_lengths(edges.size());
+    double reference_seconds = _measure_seconds([&]() {
+        for (size_t edge_index = 0; edge_index < edges.size(); ++edge_index) {
+            auto polyline = geometries.polyline(edges[edge_index].geometry);
+            float length = 0;
+            for (size_t index = 0; index + 1 < polyline.size(); ++index) {
+                length += osmium::geom::haversine::distance(polyline[index], polyline[index + 1]);
+            }
+            reference_lengths[edge_index] = length;
+        }
+    });
+    std::cout << "osmium haversine       : " << reference_seconds * 1e9 / nb_segments << " ns/segment" << std::endl;
+
+    auto bench = [&](uwpreprocess::DistanceMode mode, uwpreprocess::DistanceKernel kernel, std::string const& name) {
+        std::vector<float> lengths(edges.size());
+        double seconds = _measure_seconds([&]() {
+            for (size_t edge_index = 0; edge_index < edges.size(); ++edge_index) {
+                auto const& geometry = edges[edge_index].geometry;
+                lengths[edge_index] = uwpreprocess::polyline_length_in_meters(
+                    geometries.locations.data() + geometry.offset, geometry.length, mode, kernel);
+            }
+        });
+        double max_relative_error = 0;
+        for (size_t edge_index = 0; edge_index < edges.size(); ++edge_index) {
+            if (reference_lengths[edge_index] > 0) {
+                double error = std::abs(lengths[edge_index] - reference_lengths[edge_index]);
+                max_relative_error = std::max(max_relative_error, error / reference_lengths[edge_index]);
+            }
+        }
+        std::cout << name << " : " << seconds * 1e9 / nb_segments << " ns/segment  (speedup = "
+                  << reference_seconds / seconds << ", max relative error = " << max_relative_error << ")"
+                  << std::endl;
+    };
+    for (auto kernel : {uwpreprocess::DistanceKernel::SCALAR, uwpreprocess::DistanceKernel::SSE2,
+                        uwpreprocess::DistanceKernel::AVX2}) {
+        if (!uwpreprocess::is_distance_kernel_supported(kernel))
+            continue;
+        std::string name = "haversine " + uwpreprocess::to_string(kernel);
+        bench(uwpreprocess::DistanceMode::HAVERSINE, kernel, name + std::string(23 - name.size(), ' '));
+    }
+    bench(uwpreprocess::DistanceMode::EQUIRECTANGULAR, uwpreprocess::best_distance_kernel(), "equirectangular (best) ");
+    return 0;
+}
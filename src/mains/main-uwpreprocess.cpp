@@ -1,56 +1,158 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <exception>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #include "graph/graphtypes.h"
 #include "graph/walking_graph.h"
 #include "gtfs/gtfs_parsed_data.h"
+#include "gtfs/service_calendar.h"
 #include "json/gtfs_serialization.h"
 #include "json/walking_graph_serialization.h"
 #include "json/polygon_serialization.h"
+#include "json/transfers_serialization.h"
+#include "json/contraction_serialization.h"
+#include "graph/transfers.h"
+#include "graph/contraction.h"
+#include "json/hub_labels_serialization.h"
+#include "graph/hub_labels.h"
+#include "json/stage_cache.h"
+#include "graph/osm_changes.h"
+#include "graph/graph.h"
+#include "graph/external_memory.h"
+#include "common/parallel.h"
 
-int main(int argc, char** argv) {
-    if (argc < 7) {
-        std::cout << "Usage:  " << argv[0]
-                  << "  <gtfs_folder>  <osm_file>  <polygon_file>  <walkspeed_km/h>  <output_dir>  <hluw_output_dir>"
-                  << std::endl;
-        std::exit(0);
+// stop-to-stop transfers are computed up to this walking time, unless another one is given on the command line :
+static constexpr const float DEFAULT_MAX_TRANSFER_WALKING_SECONDS = 600;
+
+// the parameters shared by all the preprocessed regions :
+struct Parameters {
+    float walkspeed_km_per_hr;
+    std::vector<float> other_walkspeeds_km_per_hr;  // each one gets its own weight profile
+    float max_transfer_walking_seconds;
+    std::string contraction_mode;
+    std::string labeling_mode;
+};
+
+// a preprocessed region (in multi-region mode, each line of the jobs file describes one of them) :
+struct Region {
+    std::string gtfs_folder;
+    std::string polygon_file;
+    std::string output_dir;
+    std::string hluw_output_dir;
+};
+
+static std::string _with_trailing_slash(std::string dir) {
+    if (dir.back() != '/') {
+        dir.push_back('/');
     }
+    return dir;
+}
 
-    const std::string gtfs_folder = argv[1];
-    const std::string osm_file = argv[2];
-    const std::string polygon_file = argv[3];
-    const float walkspeed_km_per_hr = std::stof(argv[4]);
-    std::string output_dir = argv[5];
-    if (output_dir.back() != '/') {
-        output_dir.push_back('/');
+// parses a number (the whole text must be a finite number), returns false if it isn't one :
+static bool _parse_float(std::string const& text, float& value) {
+    size_t nb_parsed_chars = 0;
+    try {
+        value = std::stof(text, &nb_parsed_chars);
+    } catch (std::exception const&) {
+        return false;
     }
+    return nb_parsed_chars == text.size() && std::isfinite(value);
+}
 
-    std::string hluw_output_dir = argv[6];
-    if (hluw_output_dir.back() != '/') {
-        hluw_output_dir.push_back('/');
+// parses the walkspeeds ("<walkspeed_km/h>[,<other_walkspeed_km/h>...]"), and the optional parameters, starting at
+// argv[first] :
+static std::optional<Parameters> _parse_parameters(int argc, char** argv, int first, std::string const& walkspeeds) {
+    Parameters parameters;
+    std::istringstream walkspeeds_stream(walkspeeds);
+    std::string walkspeed;
+    std::vector<float> walkspeeds_km_per_hr;
+    while (std::getline(walkspeeds_stream, walkspeed, ',')) {
+        float walkspeed_km_per_hr;
+        if (!_parse_float(walkspeed, walkspeed_km_per_hr)) {
+            std::cout << "ERROR - invalid walkspeed : '" << walkspeed << "' (in " << walkspeeds << ")" << std::endl;
+            return std::nullopt;
+        }
+        walkspeeds_km_per_hr.push_back(walkspeed_km_per_hr);
+        if (walkspeeds_km_per_hr.back() <= 0) {
+            std::cout << "ERROR - the walkspeeds must be positive : " << walkspeeds << std::endl;
+            return std::nullopt;
+        }
+    }
+    if (!walkspeeds.empty() && walkspeeds.back() == ',') {
+        std::cout << "ERROR - invalid walkspeed : '' (in " << walkspeeds << ")" << std::endl;
+        return std::nullopt;
+    }
+    if (walkspeeds_km_per_hr.empty()) {
+        std::cout << "ERROR - no walkspeed given" << std::endl;
+        return std::nullopt;
+    }
+    parameters.walkspeed_km_per_hr = walkspeeds_km_per_hr.front();
+    parameters.other_walkspeeds_km_per_hr.assign(walkspeeds_km_per_hr.begin() + 1, walkspeeds_km_per_hr.end());
+    parameters.max_transfer_walking_seconds = DEFAULT_MAX_TRANSFER_WALKING_SECONDS;
+    if (argc > first) {
+        // (0 disables the transfers) :
+        if (!_parse_float(argv[first], parameters.max_transfer_walking_seconds) ||
+            parameters.max_transfer_walking_seconds < 0) {
+            std::cout << "ERROR - invalid max transfer walking time (in seconds) : " << argv[first] << std::endl;
+            return std::nullopt;
+        }
     }
 
-    std::cout << "GTFS FOLDER      = " << gtfs_folder << std::endl;
-    std::cout << "OSMFILE          = " << osm_file << std::endl;
-    std::cout << "POLYGONFILE      = " << polygon_file << std::endl;
-    std::cout << "WALKSPEED KM/H   = " << walkspeed_km_per_hr << std::endl;
-    std::cout << "OUTPUT_DIR       = " << output_dir << std::endl;
-    std::cout << "HL-UW OUTPUT_DIR = " << hluw_output_dir << std::endl;
-    std::cout << std::endl;
+    parameters.contraction_mode = argc > first + 1 ? argv[first + 1] : "none";
+    if (parameters.contraction_mode != "none" && parameters.contraction_mode != "stops-last" &&
+        parameters.contraction_mode != "stops-kept") {
+        std::cout << "ERROR - unknown contraction mode : " << parameters.contraction_mode << std::endl;
+        return std::nullopt;
+    }
 
-    // gtfs :
-    std::vector<uwpreprocess::Stop> stops;
-    {
+    parameters.labeling_mode = argc > first + 2 ? argv[first + 2] : "none";
+    if (parameters.labeling_mode != "none" && parameters.labeling_mode != "hub-labels") {
+        std::cout << "ERROR - unknown labeling mode : " << parameters.labeling_mode << std::endl;
+        return std::nullopt;
+    }
+    return parameters;
+}
+
+static void _print_parameters(Parameters const& parameters) {
+    std::cout << "WALKSPEED KM/H   = " << parameters.walkspeed_km_per_hr << std::endl;
+    for (float other_walkspeed_km_per_hr : parameters.other_walkspeeds_km_per_hr) {
+        std::cout << "OTHER WALKSPEED  = " << other_walkspeed_km_per_hr << std::endl;
+    }
+    std::cout << "MAX TRANSFER (s) = " << parameters.max_transfer_walking_seconds << std::endl;
+    std::cout << "CONTRACTION      = " << parameters.contraction_mode << std::endl;
+    std::cout << "LABELING         = " << parameters.labeling_mode << std::endl;
+}
+
+// dumps the GTFS data of the region (or copies it from the cache, if any), and fills the stops for the walking-graph :
+static bool _process_gtfs(Region const& region,
+                          std::optional<uwpreprocess::ServiceWindow> const& service_window,
+                          uwpreprocess::json::StageCache const* cache,
+                          std::vector<uwpreprocess::Stop>& stops,
+                          size_t nb_threads) {
+    std::string const gtfs_json = region.output_dir + "gtfs.json";
+    std::string const stoptimes = region.hluw_output_dir + "stoptimes.txt";
+    const std::string gtfs_key = cache ? uwpreprocess::json::gtfs_stage_key(region.gtfs_folder, service_window) : "";
+    if (cache && cache->load_gtfs_stage(gtfs_key, gtfs_json, stoptimes, stops)) {
+        std::cout << "GTFS stage loaded from cache (" << gtfs_key << ")" << std::endl;
+        return true;
+    }
+
+    {  // (the dumped files are closed at the end of this scope, before being stored in the cache)
         std::cout << "Parsing GTFS folder" << std::endl;
-        uwpreprocess::GtfsParsedData gtfs_data{gtfs_folder};
+        uwpreprocess::GtfsParsedData gtfs_data{region.gtfs_folder, nb_threads, service_window};
 
         std::cout << "Dumping GTFS as json" << std::endl;
-        std::ofstream out_gtfs(output_dir + "gtfs.json");
+        std::ofstream out_gtfs(gtfs_json);
         uwpreprocess::json::serialize_gtfs(gtfs_data, out_gtfs);
 
         std::cout << "Dumping HL-UW stoptimes" << std::endl;
-        std::ofstream out_stoptimes(hluw_output_dir + "stoptimes.txt");
+        std::ofstream out_stoptimes(stoptimes);
         gtfs_data.to_hluw_stoptimes(out_stoptimes);
 
         // note : this conversion is only necessary so that Graph doesn't depend on GtfsParsing :
@@ -61,25 +163,372 @@ int main(int argc, char** argv) {
 
         if (!uwpreprocess::json::_check_serialization_idempotent(gtfs_data)) {
             std::cout << "ERROR - gtfs serialization is not idempotent !" << std::endl;
-            return 1;
+            return false;
         }
     }
+    if (cache) {
+        cache->store_gtfs_stage(gtfs_key, gtfs_json, stoptimes, stops);
+    }
+    return true;
+}
 
-    // walking-graph :
-    std::cout << "Getting polygon" << std::endl;
-    uwpreprocess::BgPolygon polygon = uwpreprocess::json::unserialize_polygon(polygon_file);
-    std::cout << "Building walking-graph" << std::endl;
-    uwpreprocess::WalkingGraph graph{osm_file, polygon, stops, walkspeed_km_per_hr};
+// dumps the walking-graph of the region, and everything computed from it (transfers, contraction, labels) :
+// (the transfers, contraction and labels only use the weights of the first walkspeed)
+static bool _process_walking_graph(uwpreprocess::WalkingGraph& graph,
+                                   Region const& region,
+                                   Parameters const& parameters,
+                                   size_t nb_threads) {
+    for (float other_walkspeed_km_per_hr : parameters.other_walkspeeds_km_per_hr) {
+        graph.add_weight_profile(other_walkspeed_km_per_hr);
+    }
 
     std::cout << "Dumping WalkingGraph for HL-UW" << std::endl;
-    uwpreprocess::json::serialize_walking_graph_hluw(graph, hluw_output_dir);
+    uwpreprocess::json::serialize_walking_graph_hluw(graph, region.hluw_output_dir);
 
     std::cout << "Dumping WalkingGraph geojson" << std::endl;
-    std::ofstream out_graph(output_dir + "walking_graph.json");
+    std::ofstream out_graph(region.output_dir + "walking_graph.json");
     uwpreprocess::json::serialize_walking_graph(graph, out_graph);
 
     if (!uwpreprocess::json::_check_serialization_idempotent(graph)) {
         std::cout << "ERROR - graph serialization is not idempotent !" << std::endl;
+        return false;
+    }
+
+    // stop-to-stop transfers :
+    if (parameters.max_transfer_walking_seconds > 0) {
+        std::cout << "Computing stop-to-stop transfers" << std::endl;
+        auto transfers = uwpreprocess::compute_transfers(graph, parameters.max_transfer_walking_seconds, nb_threads);
+
+        std::cout << "Dumping transfers" << std::endl;
+        std::ofstream out_transfers_bin(region.output_dir + "transfers.bin", std::ios::binary);
+        uwpreprocess::json::serialize_transfers_binary(transfers, out_transfers_bin);
+        std::ofstream out_transfers_gtfs(region.output_dir + "transfers.txt");
+        uwpreprocess::json::serialize_transfers_gtfs(transfers, graph.stops_with_closest_node, out_transfers_gtfs);
+
+        if (!uwpreprocess::json::_check_serialization_idempotent(transfers)) {
+            std::cout << "ERROR - transfers serialization is not idempotent !" << std::endl;
+            return false;
+        }
+    }
+
+    // contraction hierarchy :
+    std::optional<uwpreprocess::ContractionHierarchy> hierarchy;
+    if (parameters.contraction_mode != "none") {
+        std::cout << "Contracting walking-graph" << std::endl;
+        auto stops_contraction = parameters.contraction_mode == "stops-kept" ? uwpreprocess::StopsContraction::KEPT
+                                                                             : uwpreprocess::StopsContraction::LAST;
+        hierarchy = uwpreprocess::contract_graph(graph, stops_contraction, nb_threads);
+
+        std::cout << "Dumping contraction hierarchy" << std::endl;
+        std::ofstream out_hierarchy(region.output_dir + "contraction_hierarchy.bin", std::ios::binary);
+        uwpreprocess::json::serialize_contraction_hierarchy_binary(*hierarchy, out_hierarchy);
+        uwpreprocess::json::serialize_contraction_hierarchy_hluw(*hierarchy, graph, region.hluw_output_dir);
+
+        if (!uwpreprocess::json::_check_serialization_idempotent(*hierarchy)) {
+            std::cout << "ERROR - contraction hierarchy serialization is not idempotent !" << std::endl;
+            return false;
+        }
+    }
+
+    // hub labels :
+    if (parameters.labeling_mode == "hub-labels") {
+        std::cout << "Computing hub labels" << std::endl;
+        auto hub_labels = uwpreprocess::compute_hub_labels(graph, hierarchy ? &*hierarchy : nullptr, nb_threads);
+
+        std::cout << "Dumping hub labels for HL-UW" << std::endl;
+        uwpreprocess::json::serialize_hub_labels_hluw(hub_labels, region.hluw_output_dir);
+
+        if (!uwpreprocess::json::_check_serialization_idempotent(hub_labels)) {
+            std::cout << "ERROR - hub labels serialization is not idempotent !" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The jobs file lists the regions, one per line :  <gtfs_folder>  <polygon_file>  <output_dir>  <hluw_output_dir>
+// (the paths are separated by whitespaces, empty lines and lines starting with '#' are ignored)
+static std::vector<Region> _parse_jobs_file(std::string const& jobs_file) {
+    std::ifstream in(jobs_file);
+    if (!in) {
+        throw std::runtime_error("ERROR : unable to read jobs file : " + jobs_file);
+    }
+    std::vector<Region> regions;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        Region region;
+        if (!(fields >> region.gtfs_folder) || region.gtfs_folder.front() == '#')
+            continue;
+        std::string extra;
+        if (!(fields >> region.polygon_file >> region.output_dir >> region.hluw_output_dir) || (fields >> extra)) {
+            throw std::runtime_error("ERROR : ill-formed line in jobs file : " + line);
+        }
+        region.output_dir = _with_trailing_slash(region.output_dir);
+        region.hluw_output_dir = _with_trailing_slash(region.hluw_output_dir);
+        regions.push_back(region);
+    }
+    return regions;
+}
+
+// Multi-region mode : the OSM file is read only once for all the regions, whose graphs are then built concurrently.
+static int _main_multi_region(int argc, char** argv, std::optional<uwpreprocess::ServiceWindow> const& service_window) {
+    const std::string jobs_file = argv[2];
+    const std::string osm_file = argv[3];
+    auto parameters = _parse_parameters(argc, argv, 5, argv[4]);
+    if (!parameters) {
+        return 1;
+    }
+    std::vector<Region> regions = _parse_jobs_file(jobs_file);
+    if (regions.empty()) {
+        std::cout << "ERROR - no region in jobs file : " << jobs_file << std::endl;
+        return 1;
+    }
+
+    std::cout << "JOBS FILE        = " << jobs_file << std::endl;
+    std::cout << "OSMFILE          = " << osm_file << std::endl;
+    _print_parameters(*parameters);
+    if (service_window) {
+        std::cout << "SERVICE DATES    = " << service_window->as_string() << std::endl;
+    }
+    for (auto const& region : regions) {
+        std::cout << "REGION           = " << region.gtfs_folder << "  " << region.polygon_file << "  "
+                  << region.output_dir << "  " << region.hluw_output_dir << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << "Getting polygons" << std::endl;
+    std::vector<uwpreprocess::BgPolygon> polygons;
+    for (auto const& region : regions) {
+        polygons.push_back(uwpreprocess::json::unserialize_polygon(region.polygon_file));
+    }
+
+    std::cout << "Building the OSM graphs of all regions" << std::endl;
+    std::vector<uwpreprocess::RegionEdges> regions_edges =
+        uwpreprocess::osm_to_graphs(osm_file, polygons, parameters->walkspeed_km_per_hr);
+
+    // each region is then processed by its own thread, the other threads being shared among the regions :
+    size_t nb_threads_per_region = std::max(size_t{1}, std::thread::hardware_concurrency() / regions.size());
+    std::vector<char> are_regions_ok(regions.size(), false);  // (not a vector<bool> : it is written concurrently)
+    uwpreprocess::parallel_for(regions.size(), regions.size(), [&](size_t, size_t region_index) {
+        Region const& region = regions[region_index];
+        try {
+            std::vector<uwpreprocess::Stop> stops;
+            if (!_process_gtfs(region, service_window, nullptr, stops, nb_threads_per_region))
+                return;
+            std::cout << "Building walking-graph of region " << region.polygon_file << std::endl;
+            auto& edges = regions_edges[region_index];
+            uwpreprocess::WalkingGraph graph{std::move(edges.edges),
+                                             std::move(edges.geometries),
+                                             polygons[region_index],
+                                             stops,
+                                             parameters->walkspeed_km_per_hr,
+                                             nullptr,
+                                             nb_threads_per_region};
+            are_regions_ok[region_index] = _process_walking_graph(graph, region, *parameters, nb_threads_per_region);
+        } catch (std::exception const& error) {
+            std::cout << "ERROR - region " << region.polygon_file << " : " << error.what() << std::endl;
+        }
+    }, 1);
+
+    bool are_all_regions_ok = true;
+    for (size_t region_index = 0; region_index < regions.size(); ++region_index) {
+        std::cout << (are_regions_ok[region_index] ? "OK     " : "FAILED ") << regions[region_index].polygon_file
+                  << "  ->  " << regions[region_index].output_dir << std::endl;
+        are_all_regions_ok = are_all_regions_ok && are_regions_ok[region_index];
+    }
+    if (!are_all_regions_ok) {
+        return 1;
+    }
+    std::cout << "All is OK" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    // leading options :
+    //  - the OSM graph is built out-of-core, the parsed ways being kept within the given memory budget
+    //  - only the trips whose service is active during the given dates are kept (and possibly unrolled, once per day)
+    std::optional<size_t> external_memory_budget_mb;
+    std::optional<uwpreprocess::ServiceWindow> service_window;
+    bool unroll_service_days = false;
+    while (argc > 1) {
+        std::string const option = argv[1];
+        int nb_skipped_arguments;
+        if (option == "--external-memory" && argc > 2) {
+            external_memory_budget_mb = std::stoul(argv[2]);
+            nb_skipped_arguments = 2;
+        } else if (option == "--service-dates" && argc > 2) {
+            service_window = uwpreprocess::parse_service_window(argv[2]);
+            nb_skipped_arguments = 2;
+        } else if (option == "--unroll-service-days") {
+            unroll_service_days = true;
+            nb_skipped_arguments = 1;
+        } else {
+            break;
+        }
+        // (the option is then skipped, so that the other arguments keep their position)
+        argv[nb_skipped_arguments] = argv[0];
+        argv += nb_skipped_arguments;
+        argc -= nb_skipped_arguments;
+    }
+    if (unroll_service_days) {
+        if (!service_window) {
+            std::cout << "ERROR - the service days can only be unrolled with --service-dates" << std::endl;
+            return 1;
+        }
+        service_window->unroll_days = true;
+    }
+
+    if (argc >= 5 && std::string{argv[1]} == "--jobs") {
+        if (external_memory_budget_mb) {
+            std::cout << "ERROR - the external-memory mode is not available in multi-region mode" << std::endl;
+            return 1;
+        }
+        return _main_multi_region(argc, argv, service_window);
+    }
+    if (argc < 7) {
+        std::cout << "Usage:  " << argv[0] << "  [--external-memory <memory_budget_MB>]"
+                  << "  [--service-dates <YYYYMMDD>[:<YYYYMMDD>]  [--unroll-service-days]]"
+                  << "  <gtfs_folder>  <osm_file>  <polygon_file>  <walkspeeds_km/h>  <output_dir>  <hluw_output_dir>"
+                  << "  [<max_transfer_walking_seconds>]  [none|stops-last|stops-kept]  [none|hub-labels]"
+                  << "  [<cache_dir>|none]  [<osm_change_file>...]" << std::endl;
+        std::cout << "   or:  " << argv[0] << "  [--service-dates <YYYYMMDD>[:<YYYYMMDD>]  [--unroll-service-days]]"
+                  << "  --jobs  <jobs_file>  <osm_file>  <walkspeeds_km/h>"
+                  << "  [<max_transfer_walking_seconds>]  [none|stops-last|stops-kept]  [none|hub-labels]"
+                  << std::endl;
+        std::cout << "(walkspeeds = <walkspeed_km/h>[,<other_walkspeed_km/h>...] : the graph is built once, and the "
+                     "weights of each other walkspeed are dumped in their own files)"
+                  << std::endl;
+        std::cout << "(transfers are computed up to " << DEFAULT_MAX_TRANSFER_WALKING_SECONDS
+                  << " seconds of walk by default, 0 disables them)" << std::endl;
+        std::cout << "(the contraction hierarchy is not computed by default, otherwise the stops are either contracted "
+                     "last, or kept uncontracted)"
+                  << std::endl;
+        std::cout << "(the hub labels are not computed by default, they use the contraction hierarchy order if any)"
+                  << std::endl;
+        std::cout << "(without a cache dir, the OSM and GTFS stages are always recomputed)" << std::endl;
+        std::cout << "(the OSM change files (.osc) are applied in their order to the cached OSM stage of the osm_file, "
+                     "thus they need a cache dir)"
+                  << std::endl;
+        std::cout << "(with --jobs, the OSM file is read once for all the regions listed in the jobs file, one per line "
+                     ":  <gtfs_folder>  <polygon_file>  <output_dir>  <hluw_output_dir>)"
+                  << std::endl;
+        std::cout << "(with --external-memory, the OSM ways are spilled to disk beyond the memory budget, which allows "
+                     "to build huge extracts : it can't be used with a cache dir)"
+                  << std::endl;
+        std::cout << "(with --service-dates, only the trips whose service is active on at least one of the dates are "
+                     "kept ; with --unroll-service-days, each of them is kept once per active date, as "
+                     "'<trip_id>@<date>', its times being relative to the first date ; the trips of the day before "
+                     "the first date that run after midnight are kept too)"
+                  << std::endl;
+        std::exit(0);
+    }
+
+    Region region;
+    region.gtfs_folder = argv[1];
+    const std::string osm_file = argv[2];
+    region.polygon_file = argv[3];
+    region.output_dir = _with_trailing_slash(argv[5]);
+    region.hluw_output_dir = _with_trailing_slash(argv[6]);
+    auto parameters = _parse_parameters(argc, argv, 7, argv[4]);
+    if (!parameters) {
+        return 1;
+    }
+    const float walkspeed_km_per_hr = parameters->walkspeed_km_per_hr;
+
+    const std::string cache_dir = argc > 10 ? argv[10] : "none";
+
+    const std::vector<std::string> osm_change_files(argv + std::min(argc, 11), argv + argc);
+    if (!osm_change_files.empty() && cache_dir == "none") {
+        std::cout << "ERROR - the OSM change files can only be applied with a cache dir" << std::endl;
+        return 1;
+    }
+    if (external_memory_budget_mb && cache_dir != "none") {
+        // (the cached OSM stage keeps all the ways, which is precisely what the external-memory mode avoids)
+        std::cout << "ERROR - the external-memory mode can't be used with a cache dir" << std::endl;
+        return 1;
+    }
+
+    std::cout << "GTFS FOLDER      = " << region.gtfs_folder << std::endl;
+    std::cout << "OSMFILE          = " << osm_file << std::endl;
+    std::cout << "POLYGONFILE      = " << region.polygon_file << std::endl;
+    std::cout << "OUTPUT_DIR       = " << region.output_dir << std::endl;
+    std::cout << "HL-UW OUTPUT_DIR = " << region.hluw_output_dir << std::endl;
+    _print_parameters(*parameters);
+    std::cout << "CACHE_DIR        = " << cache_dir << std::endl;
+    if (service_window) {
+        std::cout << "SERVICE DATES    = " << service_window->as_string() << std::endl;
+    }
+    if (external_memory_budget_mb) {
+        std::cout << "EXTERNAL MEMORY  = " << *external_memory_budget_mb << " MB" << std::endl;
+    }
+    for (auto const& osm_change_file : osm_change_files) {
+        std::cout << "OSM CHANGE FILE  = " << osm_change_file << std::endl;
+    }
+    std::cout << std::endl;
+
+    // the stages whose inputs are unchanged since a previous run are loaded from the cache (if any) :
+    std::optional<uwpreprocess::json::StageCache> cache;
+    if (cache_dir != "none") {
+        cache.emplace(cache_dir);
+    }
+
+    // gtfs :
+    std::vector<uwpreprocess::Stop> stops;
+    if (!_process_gtfs(region, service_window, cache ? &*cache : nullptr, stops, std::thread::hardware_concurrency())) {
+        return 1;
+    }
+
+    // walking-graph :
+    std::cout << "Getting polygon" << std::endl;
+    uwpreprocess::BgPolygon polygon = uwpreprocess::json::unserialize_polygon(region.polygon_file);
+    std::cout << "Building walking-graph" << std::endl;
+    auto build_walking_graph = [&]() -> uwpreprocess::WalkingGraph {
+        if (external_memory_budget_mb) {
+            uwpreprocess::ExternalMemoryOptions options{*external_memory_budget_mb * 1024 * 1024};
+            uwpreprocess::GeometryArena osm_geometries;
+            auto osm_edges = uwpreprocess::osm_to_graph_external(osm_file, polygon, walkspeed_km_per_hr,
+                                                                 osm_geometries, options);
+            return {std::move(osm_edges), std::move(osm_geometries), polygon, stops, walkspeed_km_per_hr};
+        }
+        if (!cache)
+            return {osm_file, polygon, stops, walkspeed_km_per_hr};
+
+        // the OSM stage is either loaded, or built (possibly by applying the change files to the cached base stage) :
+        const std::string base_key = uwpreprocess::json::osm_stage_key(osm_file, polygon, walkspeed_km_per_hr);
+        const std::string osm_key = osm_change_files.empty()
+                                        ? base_key
+                                        : uwpreprocess::json::osm_changes_key(base_key, osm_change_files);
+        uwpreprocess::OsmWaysGraph osm_graph;
+        uwpreprocess::PreviousSnapping snapping;
+        bool has_snapping = false;
+        if (cache->load_osm_stage(osm_key, osm_graph)) {
+            std::cout << "OSM stage loaded from cache (" << osm_key << ")" << std::endl;
+            has_snapping = cache->load_snapping(osm_key, snapping);  // (same graph : no changed nodes)
+        } else {
+            if (cache->load_osm_stage(base_key, osm_graph)) {
+                std::cout << "OSM stage loaded from cache (" << base_key << ")" << std::endl;
+            } else {
+                osm_graph = uwpreprocess::osm_to_ways_graph(osm_file, polygon, walkspeed_km_per_hr);
+                cache->store_osm_stage(base_key, osm_graph);
+            }
+            if (!osm_change_files.empty()) {
+                std::cout << "Applying OSM change files" << std::endl;
+                // the stops are snapped again only around the nodes that changed since the base stage :
+                has_snapping = cache->load_snapping(base_key, snapping);
+                snapping.changed_nodes =
+                    uwpreprocess::apply_osm_changes(osm_graph, osm_change_files, polygon, walkspeed_km_per_hr);
+                cache->store_osm_stage(osm_key, osm_graph);
+            }
+        }
+        uwpreprocess::WalkingGraph graph{std::move(osm_graph.edges), std::move(osm_graph.geometries), polygon, stops,
+                                         walkspeed_km_per_hr, has_snapping ? &snapping : nullptr};
+        cache->store_snapping(osm_key, graph);
+        return graph;
+    };
+    uwpreprocess::WalkingGraph graph = build_walking_graph();
+
+    if (!_process_walking_graph(graph, region, *parameters, std::thread::hardware_concurrency())) {
         return 1;
     }
 
@@ -12,6 +12,8 @@ CMAKE_ROOT_DIR="$this_script_parent/src"
 SCRIPTS_DIR="$this_script_parent/scripts"
 DATA_DIR="$this_script_parent/data"
 WALKSPEED_KMH=4.7
+MAX_TRANSFER_WALKING_SECONDS=600  # walking transfers between stops are computed up to this duration
+CACHE_DIR="$this_script_parent/UWPREPROCESS_CACHE"  # unchanged OSM/GTFS stages are reused from one run to the next
 echo "BUILD_DIR=$BUILD_DIR"
 echo "CMAKE_ROOT_DIR=$CMAKE_ROOT_DIR"
 
@@ -86,7 +88,11 @@ set -o xtrace
     "$INPUT_POLYGON_FILE" \
     "$WALKSPEED_KMH" \
     "$OUTPUT_DIR" \
-    "$HLUW_OUTPUT_DIR"
+    "$HLUW_OUTPUT_DIR" \
+    "$MAX_TRANSFER_WALKING_SECONDS" \
+    none \
+    none \
+    "$CACHE_DIR"
 set +o xtrace
 
 